@@ -2,6 +2,9 @@
 #ifndef ADDRES_H
 #define ADDRES_H
 
+#include <sys/un.h>
+#include <sys/socket.h>
+
 /** protected structure*/
 typedef struct address_s address_t;
 
@@ -23,4 +26,7 @@ const char* address_get_proto(address_t* address);
 /** get address port */
 int address_get_port(address_t* address);
 
+/** fill unix socket address of unix and shm protos, host '@' prefix selects abstract namespace, return address length or 0 */
+socklen_t address_get_unix(address_t* address, struct sockaddr_un* sun);
+
 #endif // ADDRES_H
@@ -0,0 +1,27 @@
+#ifndef ARENAS_H
+#define ARENAS_H
+
+#include <stddef.h>
+
+/** this structure are protected */
+typedef struct arenas_s arenas_t;
+
+/** create arenas_t bump allocator with chunk size */
+arenas_t* arenas_create(size_t size);
+
+/** destroy arenas_t, deferred destroys are run first */
+void arenas_destroy(void* data);
+
+/** allocate zeroed memory from arena, freed by arenas_reset only */
+void* arenas_alloc(arenas_t* arena, size_t size);
+
+/** copy string to arena */
+char* arenas_strdup(arenas_t* arena, const char* str);
+
+/** run destroy_f for data on next arenas_reset, for heap data owned by arena data */
+int arenas_defer(arenas_t* arena, void (*destroy_f)(void*), void* data);
+
+/** release everything allocated from arena, first chunk is kept for reuse */
+void arenas_reset(arenas_t* arena);
+
+#endif // ARENAS_H
@@ -19,9 +19,36 @@ client_t* client_cluster(cluster_t* cluster);
 /** destroy client_t */
 void client_destroy(void* data);
 
-/** client request */
+/** set request deadline in milliseconds, 0 waits forever, stream timed out waiting answer is reconnected and loses pipelined requests and subscriptions */
+int client_timeout(client_t* client, int timeout);
+
+/** client request, args stay owned by caller and are no longer destroyed, answer is matched by request id so answers of pipelined requests readed meanwhile are kept for client_recv */
 int client_request(client_t* client, const char* module, const char* thread, const char* method, json_node_t* args, json_node_t* *answer);
 
+/** resolve module thread method to handle valid on this client connection, udp clients have no handles */
+int client_resolve(client_t* client, const char* module, const char* thread, const char* method, unsigned int* handle);
+
+/** client request by handle got from client_resolve, args stay owned by caller and are no longer destroyed, answer is matched by request id */
+int client_handle_request(client_t* client, unsigned int handle, json_node_t* args, json_node_t* *answer);
+
+/** client pipelined request, id is set to the request id, args stay owned by caller */
+int client_send(client_t* client, const char* module, const char* thread, const char* method, json_node_t* args, unsigned int* id);
+
+/** client pipelined answer, answers come in completion order including ones readed by other calls meanwhile, id is set to the answered request id, error when none is in flight */
+int client_recv(client_t* client, unsigned int* id, json_node_t* *answer);
+
+/** subscribe to thread state and property changes, NULL module or thread matches any */
+int client_subscribe(client_t* client, const char* module, const char* thread, unsigned int* subscription);
+
+/** next event pushed to subscribed client, waits when none is queued, error without subscription, answers readed meanwhile are kept for client_recv */
+int client_event(client_t* client, json_node_t* *event);
+
+/** client batch request, requests is array built by client_batch_add, answers is array in the same order */
+int client_batch(client_t* client, json_node_t* requests, int parallel, json_node_t* *answers);
+
+/** append request to batch array, args are owned by batch after call */
+int client_batch_add(json_node_t* requests, const char* module, const char* thread, const char* method, json_node_t* args);
+
 /** client file request */
 int client_file_request(client_t* client, const char* file, json_node_t* *answer);
 
@@ -0,0 +1,30 @@
+#ifndef EPOCHS_H
+#define EPOCHS_H
+
+#include <stdint.h>
+
+/** enter read section, pointers loaded inside stay valid until epochs_leave, sections nest */
+void epochs_enter();
+
+/** leave read section */
+void epochs_leave();
+
+/** wait until read sections entered by other threads before the call are left */
+void epochs_synchronize();
+
+/** free data with destroy once read sections open at the call are left, never waits */
+void epochs_retire(void* data, void (*destroy)(void*));
+
+/** free retired data no section reads anymore, never waits */
+void epochs_reclaim();
+
+/** get current epoch, lookups cached inside a section stay valid while it is the same */
+uint64_t epochs_current();
+
+/** load pointer published by epochs_publish, call inside read section */
+void* epochs_load(void* *ptr);
+
+/** publish pointer for readers, old value is freed by writer after epochs_synchronize */
+void epochs_publish(void* *ptr, void* value);
+
+#endif // EPOCHS_H
@@ -0,0 +1,55 @@
+
+#ifndef FRAMER_H
+#define FRAMER_H
+
+#include <stdint.h>
+
+/** frame header length word flag, request id word follows the length word */
+#define FRAME_FLAG_ID 0x80000000U
+
+/** frame header length word flag, next frame continues the same message */
+#define FRAME_FLAG_MORE 0x40000000U
+
+/** frame header length word mask */
+#define FRAME_SIZE_MASK 0x3fffffffU
+
+/** frame request id word size */
+#define FRAME_ID_SIZE 4
+
+/** request id of frames pushed by server without request, clients do not send it */
+#define FRAME_PUSH_ID 0
+
+/** max frame size, header included, carried in one udp datagram */
+#define FRAME_DATAGRAM_SIZE 65507
+
+/** this structure are protected */
+typedef struct framer_s framer_t;
+
+/** create framer_t buffering frames of sock */
+framer_t* framer_create(int sock);
+
+/** destroy framer_t, sock is not closed */
+void framer_destroy(void* data);
+
+/** read available bytes to framer buffer, several frames may come with one read, return read() result */
+int framer_fill(framer_t* framer);
+
+/** append bytes received by other means than framer_fill, -1 when IO_MESSAGE_SIZE is buffered */
+int framer_feed(framer_t* framer, const char* data, uint32_t size);
+
+/** get next buffered frame without dropping it, return 1 on frame, 0 if more bytes needed, -1 on invalid frame */
+int framer_frame(framer_t* framer, uint32_t* flags, uint32_t* id, const char* *buffer, uint32_t* size);
+
+/** drop frame got by framer_frame */
+void framer_drop(framer_t* framer);
+
+/** non zero when a whole frame is buffered and not dropped yet */
+int framer_ready(framer_t* framer);
+
+/** read next frame, wait while it is not complete, buffer is valid until next framer call */
+int framer_read(framer_t* framer, uint32_t* flags, uint32_t* id, const char* *buffer, uint32_t* size);
+
+/** write frame header and body with one writev */
+int framer_write(framer_t* framer, uint32_t flags, uint32_t id, const char* buffer, uint32_t size);
+
+#endif // FRAMER_H
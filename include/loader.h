@@ -4,6 +4,7 @@
 
 #include <parser.h>
 #include <thread.h>
+#include <epochs.h>
 
 /** this structure are protected */
 typedef struct loader_s loader_t;
@@ -11,6 +12,18 @@ typedef struct loader_s loader_t;
 /** create loader */
 loader_t* loader_create(const char* file);
 
+/** load new version of loader module from file (NULL for the same file) through a copy in $TMPDIR (/tmp if unset), threads and properties are copied, loader_retire copies properties changed meanwhile, error is set to the reason on failure */
+loader_t* loader_reload(loader_t* loader, const char* file, const char** error);
+
+/** wait calls and completions on replaced loader, move started threads to reload and destroy loader */
+void loader_retire(loader_t* loader, loader_t* reload);
+
+/** count call in flight, take inside epochs read section, loader_retire waits until every one is released */
+void loader_acquire(loader_t* loader);
+
+/** finish call counted by loader_acquire */
+void loader_release(loader_t* loader);
+
 /** destroy loader */
 void loader_destroy(void* data);
 
@@ -23,16 +36,28 @@ const char* loader_name(loader_t* loader);
 /** get loader file */
 const char* loader_file(loader_t* loader);
 
+/** get module method by name from loader index */
+method_t* loader_method(loader_t* loader, const char* name);
+
 /** answer loader info */
 int loader_info(loader_t* loader, json_node_t* info);
 
-/** set to loader */
+/** get loader pool size */
+int loader_threads(loader_t* loader);
+
+/** call thread_f for every pooled thread inside epochs read section */
+int loader_foreach(loader_t* loader, void (*thread_f)(void* data, thread_t* thread), void* data);
+
+/** set to loader, replaced thread is destroyed after its calls are released */
 int set_to_loader(loader_t* loader, thread_t* thread);
 
-/** get from loader */
+/** get from loader, call inside epochs read section, thread is valid until it is left or thread_acquire taken inside is released */
 thread_t* get_from_loader(loader_t* loader, const char* name);
 
-/** get loader locker */
+/** get loader pool generation, changed by every set_to_loader */
+uint64_t loader_generation(loader_t* loader);
+
+/** get loader locker, serializes loader writers */
 locker_t* loader_locker(loader_t* loader);
 
 #endif // LOADER_H
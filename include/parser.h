@@ -9,6 +9,8 @@
 typedef struct parser_s parser_t;
 /** protected structure */
 typedef struct json_node_s json_node_t;
+/** protected structure */
+typedef struct json_cursor_s json_cursor_t;
 
 typedef enum json_node_type_e json_node_type_t;
 typedef enum json_style_e json_style_t;
@@ -46,12 +48,27 @@ json_node_t* parser_parse_buffer(parser_t* parser, const char* buffer, int len);
 /** parse string to json_node_t */
 json_node_t* parser_parse_string(parser_t* parser, const char* str);
 
+/** set calling thread arena for json_node_* constructors and parser trees, NULL for heap, return previous arena */
+arenas_t* json_node_arena(arenas_t* arena);
+
 /** destroy json_node_t */
 void json_node_destroy(void* data);
 
 /** print json node to char */
 int json_node_print(json_node_t* node, json_style_t style, int* len, char* str);
 
+/** write json node by parts to write_f, stop on first write_f error */
+int json_node_write(json_node_t* node, json_style_t style, int (*write_f)(void* data, const char* str, int len), void* data);
+
+/** create cursor writing json node in parts, node must live until the cursor is destroyed */
+json_cursor_t* json_cursor_create(json_node_t* node, json_style_t style);
+
+/** write next parts of node until budget bytes are written, return 1 if more is left, 0 when done, -1 on error */
+int json_cursor_write(json_cursor_t* cursor, int budget, int (*write_f)(void* data, const char* str, int len), void* data);
+
+/** destroy json cursor */
+void json_cursor_destroy(void* data);
+
 /** Create json_node_t* type JSON_NODE_TYPE_OBJECT */
 json_node_t* json_node_object(rbtree_t* tree);
 
@@ -64,6 +81,9 @@ json_node_t* json_node_array(vector_t* vector);
 /** get element from array by id */
 json_node_t* json_node_array_node(json_node_t* node, int id);
 
+/** get array elements vector for in order iteration */
+vector_t* json_node_array_vector(json_node_t* node);
+
 /** Create json_node_t* type JSON_NODE_TYPE_STRING */
 json_node_t* json_node_string(const char* value);
 
@@ -73,6 +93,9 @@ const char* json_node_string_value(json_node_t* node);
 /** Create json_node_t* type JSON_NODE_TYPE_INTEGER */
 json_node_t* json_node_int(int value);
 
+/** Create json_node_t* type JSON_NODE_TYPE_INTEGER wide enough for 64 bit counters */
+json_node_t* json_node_long(long long value);
+
 /** */
 int json_node_int_value(json_node_t* node);
 
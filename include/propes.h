@@ -28,6 +28,12 @@ const char* get_from_propes(propes_t* propes, const char* name);
 /**set property value*/
 int set_to_propes(propes_t* propes, const char* name, const char* value);
 
+/** set property value without calling observer, for values copied from other propes */
+int set_to_propes_quiet(propes_t* propes, const char* name, const char* value);
+
+/** set observer called after set_to_propes changes a value */
+int propes_observe(propes_t* propes, void (*observe_f)(void* data, property_t* property, const char* value), void* data);
+
 /** property type validator (none) */
 const char* check_type_str(property_t* property, const char* value);
 
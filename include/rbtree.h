@@ -2,6 +2,8 @@
 #ifndef RBTREE_H
 #define RBTREE_H
 
+#include <arenas.h>
+
 /** this structure are protected */
 typedef struct rbtree_s rbtree_t;
 
@@ -11,6 +13,12 @@ typedef struct rbtree_iterator_s rbtree_iterator_t;
 /** create rbtree object. return NULL if error, rbtree_t* if success */
 rbtree_t* rbtree_create(void(*destroy_key_f)(void*), void(*destroy_data_f)(void*));
 
+/** create rbtree object allocated from arena, entries are released by arenas_reset */
+rbtree_t* rbtree_arena(arenas_t* arena, void(*destroy_key_f)(void*), void(*destroy_data_f)(void*));
+
+/** create copy of rbtree sharing keys and data, copy does not destroy them */
+rbtree_t* rbtree_clone(rbtree_t* rbtree);
+
 /** destroy rbtree_t object */
 void rbtree_destroy(void* data);
 
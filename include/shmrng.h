@@ -0,0 +1,31 @@
+
+#ifndef SHMRNG_H
+#define SHMRNG_H
+
+#include <stdint.h>
+
+/** this structure are protected */
+typedef struct shmrng_s shmrng_t;
+
+/** create memfd ring pair of size bytes each way and pass it to the client over unix sock */
+shmrng_t* shmrng_accept(int sock, uint32_t size);
+
+/** attach ring pair passed by the server over unix sock */
+shmrng_t* shmrng_connect(int sock);
+
+/** destroy shmrng_t, sock is not closed */
+void shmrng_destroy(void* data);
+
+/** read next frame, wait while it is not complete, buffer is valid until next shmrng call, -1 with EINTR after shmrng_interrupt */
+int shmrng_read(shmrng_t* shm, uint32_t* flags, uint32_t* id, const char* *buffer, uint32_t* size);
+
+/** write frame and wake the peer if it sleeps */
+int shmrng_write(shmrng_t* shm, uint32_t flags, uint32_t id, const char* buffer, uint32_t size);
+
+/** make reader waiting for next frame return, may be called from any thread */
+void shmrng_interrupt(shmrng_t* shm);
+
+/** milliseconds one read or write waits for the peer before -1 with EAGAIN, 0 waits while the peer is alive */
+void shmrng_timeout(shmrng_t* shm, int timeout);
+
+#endif // SHMRNG_H
@@ -2,6 +2,7 @@
 #ifndef THREAD_H
 #define THREAD_H
 
+#include <time.h>
 #include <parser.h>
 #include <rbtree.h>
 #include <propes.h>
@@ -14,10 +15,14 @@ typedef struct thread_s thread_t;
 typedef struct method_s method_t;
 /** this structure are protected */
 typedef struct module_s module_t;
+/** this structure are protected */
+typedef struct completion_s completion_t;
+typedef struct deadline_s deadline_t;
 
 typedef enum thread_lock_e thread_lock_t;
 typedef enum thread_state_e thread_state_t;
 typedef enum thread_method_state_e thread_method_state_t;
+typedef enum thread_event_e thread_event_t;
 
 enum thread_state_e {
 
@@ -32,6 +37,12 @@ enum thread_method_state_e {
 	THREAD_METHOD_OK    =  0,
 };
 
+enum thread_event_e {
+
+	THREAD_EVENT_STATE    = 0,
+	THREAD_EVENT_PROPERTY = 1,
+};
+
 enum thread_lock_e {
 
 	THREAD_LOCK_READ    = 1,
@@ -43,9 +54,21 @@ enum thread_lock_e {
 struct method_s {
 
 	char* name;
+	// nodes made by the module come from heap, request and answer may be arena nodes released after the call
 	int (*run)(thread_t* thread, json_node_t* request, json_node_t* answer);
 	char* description;
 	char* jsont;
+
+	// used instead of run when set, the answer is given later with completion_done
+	int (*async)(thread_t* thread, json_node_t* request, completion_t* completion);
+};
+
+// budget of a request, filled by the server before the call
+struct deadline_s {
+
+	struct timespec at;
+	int set;
+	volatile int* cancel;
 };
 
 struct module_s {
@@ -82,6 +105,12 @@ thread_t* thread_create(module_t* module, const char* name);
 /** destroy thread_t */
 void thread_destroy(void* data);
 
+/** count call in flight on thread, thread_destroy waits until every one is released */
+void thread_acquire(thread_t* thread);
+
+/** finish call counted by thread_acquire */
+void thread_release(thread_t* thread);
+
 /** set thread state from other thread */
 void thread_state_set(thread_t* thread, thread_state_t state);
 
@@ -118,4 +147,31 @@ locker_t* thread_locker(thread_t* thread);
 /** get thread info */
 int thread_info(thread_t* thread, json_node_t* info);
 
+/** set observer of thread state and property changes, it is called on the changing thread */
+void thread_observe(void (*observe_f)(void* data, thread_t* thread, thread_event_t event, const char* name, const char* value), void* data);
+
+/** create completion_t, done_f gets answer on completion_done, answer is created when NULL and destroyed after done_f */
+completion_t* completion_create(json_node_t* answer, void (*done_f)(void* data, json_node_t* answer), void* data);
+
+/** get completion answer, filled by async method from any thread before completion_done */
+json_node_t* completion_answer(completion_t* completion);
+
+/** finish async method, request passed to async is not valid here, completion is freed */
+void completion_done(completion_t* completion);
+
+/** remaining milliseconds of completion request before completion_done, -1 without deadline, 0 when expired or cancelled */
+long completion_remaining(completion_t* completion);
+
+/** non zero when completion request is expired or its client is gone */
+int completion_cancelled(completion_t* completion);
+
+/** set deadline of requests called by this thread, returns previous one */
+deadline_t* deadline_enter(deadline_t* deadline);
+
+/** remaining milliseconds of request called by this thread, -1 without deadline, 0 when expired or cancelled */
+long deadline_remaining();
+
+/** non zero when request called by this thread is expired or its client is gone */
+int deadline_cancelled();
+
 #endif // THREAD_H
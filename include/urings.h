@@ -0,0 +1,29 @@
+
+#ifndef URINGS_H
+#define URINGS_H
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+/** this structure are protected */
+typedef struct urings_s urings_t;
+
+/** create io_uring instance with entries submission slots */
+urings_t* urings_create(unsigned int entries);
+
+/** destroy urings_t */
+void urings_destroy(void* data);
+
+/** get cleared submission entry, pending entries are submitted when the queue is full */
+struct io_uring_sqe* urings_sqe(urings_t* ring);
+
+/** submit pending entries and wait for wait completions */
+int urings_submit(urings_t* ring, unsigned int wait);
+
+/** get next completion or NULL, it stays valid until urings_seen */
+struct io_uring_cqe* urings_cqe(urings_t* ring);
+
+/** release completion got by urings_cqe */
+void urings_seen(urings_t* ring);
+
+#endif // URINGS_H
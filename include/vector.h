@@ -2,6 +2,8 @@
 #ifndef VECTOR_H
 #define VECTOR_H
 
+#include <arenas.h>
+
 /** this structure are protected */
 typedef struct vector_s vector_t;
 /** this structure are protected */
@@ -10,6 +12,9 @@ typedef struct vector_iterator_s vector_iterator_t;
 /** create vector_t struct */
 vector_t* vector_create(int blks, void (*destroy_data_f)(void*));
 
+/** create vector_t struct allocated from arena, released by arenas_reset */
+vector_t* vector_arena(arenas_t* arena, int blks, void (*destroy_data_f)(void*));
+
 /** destroy vector_t struct */
 void vector_destroy(void* data);
 
@@ -0,0 +1,34 @@
+#ifndef WHEELS_H
+#define WHEELS_H
+
+#include <stdint.h>
+
+/** this structure are protected */
+typedef struct wheels_s wheels_t;
+typedef struct wheels_timer_s wheels_timer_t;
+
+// embedded by its owner, linked into one wheel slot at a time
+struct wheels_timer_s {
+
+	uint64_t expire;
+	void* data;
+	wheels_timer_t* next;
+	wheels_timer_t** prev;
+};
+
+/** create wheels_t hierarchical timer wheel, tick in milliseconds, now is the start time */
+wheels_t* wheels_create(uint32_t tick, uint64_t now);
+
+/** destroy wheels_t, linked timers are left to their owners */
+void wheels_destroy(void* data);
+
+/** link timer expiring timeout milliseconds after wheel time, linked timer is moved */
+void wheels_add(wheels_t* wheels, wheels_timer_t* timer, uint64_t timeout);
+
+/** unlink timer, unlinked timer is ignored */
+void wheels_del(wheels_t* wheels, wheels_timer_t* timer);
+
+/** advance wheel time to now, expired timers are unlinked and returned chained by next */
+wheels_timer_t* wheels_expire(wheels_t* wheels, uint64_t now);
+
+#endif // WHEELS_H
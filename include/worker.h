@@ -0,0 +1,28 @@
+
+#ifndef WORKER_H
+#define WORKER_H
+
+#include <parser.h>
+
+/** this structure are protected */
+typedef struct worker_s worker_t;
+
+/** create worker_t pool with threads count and bounded queue depth */
+worker_t* worker_create(int threads, int depth);
+
+/** destroy worker_t, queued jobs are finished before return */
+void worker_destroy(void* data);
+
+/** push job to worker queue, wait while queue is full */
+int worker_push(worker_t* worker, void (*run_f)(void*), void* data);
+
+/** push job to worker queue, fail instead of waiting when queue is full */
+int worker_try(worker_t* worker, void (*run_f)(void*), void* data);
+
+/** get worker queue depth */
+int worker_depth(worker_t* worker);
+
+/** answer worker info */
+int worker_info(worker_t* worker, json_node_t* info);
+
+#endif // WORKER_H
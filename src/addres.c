@@ -1,4 +1,5 @@
 
+#include <stddef.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
@@ -31,12 +32,13 @@ address_t* address_create(const char* url) {
 	if (!token)
 		goto address_error;
 
+	address->port = 0;
 	strncpy(address->proto, token, sizeof(address->proto));
 	strncpy(address->url, url, sizeof(address->url));
 
-	if (!strcmp(token, "unix")) { // local io
+	if (!strcmp(token, "unix") || !strcmp(token, "shm")) { // local io
 
-		if (ptr) {
+		if (ptr && *ptr) {
 			strncpy(address->host, ptr, sizeof(address->host));
 			return address;
 		}
@@ -118,3 +120,25 @@ int address_get_port(address_t* address) {
 
 	return -1;
 }
+
+socklen_t address_get_unix(address_t* address, struct sockaddr_un* sun) {
+
+	if (!address || !sun || (strcmp(address->proto, "unix") && strcmp(address->proto, "shm")))
+		return 0;
+
+	size_t len = strnlen(address->host, sizeof(address->host));
+	if (!len || len >= sizeof(sun->sun_path))
+		return 0;
+
+	memset(sun, 0, sizeof(*sun));
+	sun->sun_family = AF_UNIX;
+	memcpy(sun->sun_path, address->host, len);
+
+	// abstract namespace name starts with zero byte and is not zero terminated
+	if (sun->sun_path[0] == '@') {
+		sun->sun_path[0] = '\0';
+		return offsetof(struct sockaddr_un, sun_path) + len;
+	}
+
+	return offsetof(struct sockaddr_un, sun_path) + len + 1;
+}
@@ -0,0 +1,137 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arenas.h"
+
+#define ARENAS_ALIGN 16
+
+typedef struct arenas_chunk_s arenas_chunk_t;
+typedef struct arenas_defer_s arenas_defer_t;
+
+struct arenas_chunk_s {
+
+	arenas_chunk_t* next;
+	size_t size;
+	size_t used;
+	char data[] __attribute__((aligned(ARENAS_ALIGN)));
+};
+
+struct arenas_defer_s {
+
+	void (*destroy_f)(void*);
+	void* data;
+	arenas_defer_t* next;
+};
+
+struct arenas_s {
+
+	size_t size;
+	arenas_chunk_t* chunk;
+	arenas_defer_t* defer;
+};
+
+static arenas_chunk_t* arenas_chunk(size_t size) {
+
+	arenas_chunk_t* chunk = malloc(sizeof(*chunk) + size);
+	if (chunk) {
+		chunk->next = NULL;
+		chunk->size = size;
+		chunk->used = 0;
+	}
+
+	return chunk;
+}
+
+arenas_t* arenas_create(size_t size) {
+
+	arenas_t* arena = calloc(1, sizeof(*arena));
+	if (arena) {
+		arena->size = size;
+		if (!(arena->chunk = arenas_chunk(size))) {
+			free(arena);
+			return NULL;
+		}
+	}
+
+	return arena;
+}
+
+void arenas_destroy(void* data) {
+
+	if (!data)
+		return;
+
+	arenas_t* arena = data;
+	arenas_reset(arena);
+	free(arena->chunk);
+	free(arena);
+}
+
+void* arenas_alloc(arenas_t* arena, size_t size) {
+
+	if (!arena)
+		return NULL;
+
+	size = (size + ARENAS_ALIGN - 1) & ~(size_t)(ARENAS_ALIGN - 1);
+
+	// chunks are linked newest first, only the newest one has room
+	arenas_chunk_t* chunk = arena->chunk;
+	if (chunk->size - chunk->used < size) {
+		if (!(chunk = arenas_chunk(size > arena->size ? size : arena->size)))
+			return NULL;
+
+		chunk->next = arena->chunk;
+		arena->chunk = chunk;
+	}
+
+	void* data = &chunk->data[chunk->used];
+	chunk->used += size;
+	return memset(data, 0, size);
+}
+
+char* arenas_strdup(arenas_t* arena, const char* str) {
+
+	if (!str)
+		return NULL;
+
+	size_t len = strlen(str) + 1;
+	char* copy = arenas_alloc(arena, len);
+	if (copy)
+		memcpy(copy, str, len);
+
+	return copy;
+}
+
+int arenas_defer(arenas_t* arena, void (*destroy_f)(void*), void* data) {
+
+	arenas_defer_t* defer = arenas_alloc(arena, sizeof(*defer));
+	if (!defer)
+		return -1;
+
+	defer->destroy_f = destroy_f;
+	defer->data = data;
+	defer->next = arena->defer;
+	arena->defer = defer;
+	return 0;
+}
+
+void arenas_reset(arenas_t* arena) {
+
+	if (!arena)
+		return;
+
+	while (arena->defer) {
+		arenas_defer_t* defer = arena->defer;
+		arena->defer = defer->next;
+		defer->destroy_f(defer->data);
+	}
+
+	// the oldest chunk is the one sized by arenas_create
+	while (arena->chunk->next) {
+		arenas_chunk_t* chunk = arena->chunk;
+		arena->chunk = chunk->next;
+		free(chunk);
+	}
+
+	arena->chunk->used = 0;
+}
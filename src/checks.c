@@ -0,0 +1,421 @@
+#include <errno.h>
+#include <stdio.h>
+#include <signal.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include "config.h"
+#include "addres.h"
+#include "client.h"
+#include "framer.h"
+#include "wheels.h"
+#include "shmrng.h"
+#include "parser.h"
+
+static int failed = 0;
+
+#define CHECK(cond) do { if (!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); failed ++; } } while (0)
+
+static void check_framer_codec(void) {
+
+	int sv[2];
+	CHECK(!socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+
+	framer_t* out = framer_create(sv[0]);
+	framer_t* in = framer_create(sv[1]);
+	CHECK(out && in);
+
+	uint32_t flags, id, size;
+	const char* buffer;
+
+	// frame with request id, frame without it, continued frame
+	CHECK(!framer_write(out, FRAME_FLAG_ID, 7, "{\"a\":1}", 7));
+	CHECK(!framer_write(out, 0, 0, "{}", 2));
+	CHECK(!framer_write(out, FRAME_FLAG_ID | FRAME_FLAG_MORE, 9, "part", 4));
+
+	CHECK(!framer_read(in, &flags, &id, &buffer, &size));
+	CHECK(flags == FRAME_FLAG_ID && id == 7 && size == 7 && !memcmp(buffer, "{\"a\":1}", 7));
+
+	// all frames came with one read, the rest is buffered
+	framer_drop(in);
+	CHECK(framer_ready(in));
+	CHECK(!framer_read(in, &flags, &id, &buffer, &size));
+	CHECK(!flags && !id && size == 2 && !memcmp(buffer, "{}", 2));
+
+	CHECK(!framer_read(in, &flags, &id, &buffer, &size));
+	CHECK(flags == (FRAME_FLAG_ID | FRAME_FLAG_MORE) && id == 9 && size == 4 && !memcmp(buffer, "part", 4));
+
+	framer_drop(in);
+	CHECK(!framer_ready(in));
+
+	// peer close ends the read
+	close(sv[0]);
+	CHECK(framer_read(in, &flags, &id, &buffer, &size) == -1);
+
+	framer_destroy(out);
+	framer_destroy(in);
+	close(sv[1]);
+}
+
+static void check_framer_feed(void) {
+
+	framer_t* framer = framer_create(-1);
+	CHECK(framer);
+
+	uint32_t flags, id, size;
+	const char* buffer;
+
+	uint32_t header[2] = { 5 | FRAME_FLAG_ID, 42 };
+	char frame[HEADER_MSG_SIZE + FRAME_ID_SIZE + 5];
+	memcpy(frame, header, HEADER_MSG_SIZE + FRAME_ID_SIZE);
+	memcpy(&frame[HEADER_MSG_SIZE + FRAME_ID_SIZE], "hello", 5);
+
+	// frame split inside header and body is not ready until its last byte
+	CHECK(!framer_feed(framer, frame, 2));
+	CHECK(!framer_ready(framer));
+	CHECK(!framer_frame(framer, &flags, &id, &buffer, &size));
+
+	CHECK(!framer_feed(framer, &frame[2], 8));
+	CHECK(!framer_ready(framer));
+	CHECK(!framer_frame(framer, &flags, &id, &buffer, &size));
+
+	CHECK(!framer_feed(framer, &frame[10], sizeof(frame) - 10));
+	CHECK(framer_ready(framer));
+	CHECK(framer_frame(framer, &flags, &id, &buffer, &size) == 1);
+	CHECK(flags == FRAME_FLAG_ID && id == 42 && size == 5 && !memcmp(buffer, "hello", 5));
+
+	// frame stays until dropped
+	CHECK(framer_frame(framer, &flags, &id, &buffer, &size) == 1);
+	framer_drop(framer);
+	CHECK(!framer_ready(framer));
+
+	// oversized length is rejected
+	uint32_t len = IO_BUFFER_SIZE + 1;
+	CHECK(!framer_feed(framer, (char*)&len, HEADER_MSG_SIZE));
+	CHECK(framer_frame(framer, &flags, &id, &buffer, &size) == -1);
+
+	framer_destroy(framer);
+}
+
+static int check_wheels_count(wheels_timer_t* timer) {
+
+	int count = 0;
+	for (; timer; timer = timer->next)
+		count ++;
+
+	return count;
+}
+
+static void check_wheels(void) {
+
+	CHECK(!wheels_create(0, 0));
+
+	wheels_t* wheels = wheels_create(10, 1000);
+	CHECK(wheels);
+
+	wheels_timer_t near = { 0 }, far = { 0 }, dead = { 0 }, moved = { 0 };
+	wheels_add(wheels, &near, 25);
+	wheels_add(wheels, &far, 100000);
+	wheels_add(wheels, &dead, 50);
+	wheels_add(wheels, &moved, 30);
+
+	// deleted timer never fires, moved timer fires at its last time
+	wheels_del(wheels, &dead);
+	wheels_del(wheels, &dead);
+	wheels_add(wheels, &moved, 5000);
+
+	// part of tick is waited as whole tick
+	CHECK(!wheels_expire(wheels, 1020));
+	wheels_timer_t* expired = wheels_expire(wheels, 1030);
+	CHECK(expired == &near && !near.next && !near.prev);
+
+	CHECK(!wheels_expire(wheels, 5990));
+	expired = wheels_expire(wheels, 6000);
+	CHECK(expired == &moved && check_wheels_count(expired) == 1);
+
+	// far timer is cascaded down from upper levels
+	CHECK(!wheels_expire(wheels, 100990));
+	expired = wheels_expire(wheels, 101000);
+	CHECK(expired == &far && check_wheels_count(expired) == 1);
+
+	// timer beyond top level reach goes round and still fires on time
+	wheels_timer_t longest = { 0 };
+	uint64_t now = 101000, timeout = (uint64_t)10 * (1 << 24) + 70;
+	wheels_add(wheels, &longest, timeout);
+	CHECK(!wheels_expire(wheels, now + timeout - 10));
+	CHECK(wheels_expire(wheels, now + timeout) == &longest);
+
+	// several timers in one slot come out together
+	wheels_timer_t many[8] = { { 0 } };
+	int i;
+	for (i = 0; i < 8; i ++)
+		wheels_add(wheels, &many[i], 640);
+	CHECK(check_wheels_count(wheels_expire(wheels, now + timeout + 640)) == 8);
+
+	wheels_destroy(wheels);
+}
+
+static void check_shmrng(void) {
+#ifdef ENABLE_SHM
+	int sv[2];
+	CHECK(!socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+
+	// ring size is a power of two
+	CHECK(!shmrng_accept(sv[0], 3000));
+
+	shmrng_t* server = shmrng_accept(sv[0], 4096);
+	shmrng_t* client = shmrng_connect(sv[1]);
+	CHECK(server && client);
+	if (!server || !client)
+		return;
+
+	uint32_t flags, id, size;
+	const char* buffer;
+	char data[1000];
+
+	// frames wrap around the ring end many times in both directions
+	int i;
+	for (i = 0; i < 64; i ++) {
+		memset(data, 'a' + i % 26, sizeof(data));
+		uint32_t len = 100 + i * 13;
+
+		CHECK(!shmrng_write(client, FRAME_FLAG_ID, i + 1, data, len));
+		CHECK(!shmrng_read(server, &flags, &id, &buffer, &size));
+		CHECK(flags == FRAME_FLAG_ID && id == (uint32_t)i + 1 && size == len && !memcmp(buffer, data, len));
+
+		CHECK(!shmrng_write(server, 0, 0, data, len));
+		CHECK(!shmrng_read(client, &flags, &id, &buffer, &size));
+		CHECK(!flags && !id && size == len && !memcmp(buffer, data, len));
+	}
+
+	// several frames are queued before the reader comes
+	CHECK(!shmrng_write(server, FRAME_FLAG_MORE, 0, "one", 3));
+	CHECK(!shmrng_write(server, 0, 0, "two", 3));
+	CHECK(!shmrng_read(client, &flags, &id, &buffer, &size));
+	CHECK(flags == FRAME_FLAG_MORE && size == 3 && !memcmp(buffer, "one", 3));
+	CHECK(!shmrng_read(client, &flags, &id, &buffer, &size));
+	CHECK(!flags && size == 3 && !memcmp(buffer, "two", 3));
+
+	// interrupted reader returns between frames
+	shmrng_interrupt(client);
+	errno = 0;
+	CHECK(shmrng_read(client, &flags, &id, &buffer, &size) == -1 && errno == EINTR);
+
+	// stalled peer times the read out
+	shmrng_timeout(client, 50);
+	errno = 0;
+	CHECK(shmrng_read(client, &flags, &id, &buffer, &size) == -1 && errno == EAGAIN);
+
+	shmrng_destroy(client);
+	shmrng_destroy(server);
+	close(sv[0]);
+	close(sv[1]);
+#endif
+}
+
+static void check_address_unix(void) {
+
+	struct sockaddr_un sun;
+
+	// path length counts its terminating zero
+	address_t* address = address_create("unix:/run/vmixer.sock");
+	CHECK(address_get_unix(address, &sun) == offsetof(struct sockaddr_un, sun_path) + strlen("/run/vmixer.sock") + 1);
+	CHECK(sun.sun_family == AF_UNIX && !strcmp(sun.sun_path, "/run/vmixer.sock"));
+	address_destroy(address);
+
+	// abstract name starts with zero byte and has no terminating zero
+	address = address_create("unix:@vmixer");
+	CHECK(address_get_unix(address, &sun) == offsetof(struct sockaddr_un, sun_path) + strlen("@vmixer"));
+	CHECK(!sun.sun_path[0] && !memcmp(&sun.sun_path[1], "vmixer", strlen("vmixer")));
+	address_destroy(address);
+
+	// shm binding is set up over the same unix socket
+	address = address_create("shm:@vmixer");
+	CHECK(address_get_unix(address, &sun) == offsetof(struct sockaddr_un, sun_path) + strlen("@vmixer"));
+	address_destroy(address);
+
+	// path without room for its terminating zero and other protos are refused
+	char url[sizeof(sun.sun_path) + 8];
+	snprintf(url, sizeof(url), "unix:/%0*d", (int)sizeof(sun.sun_path) - 1, 0);
+	address = address_create(url);
+	CHECK(address && !address_get_unix(address, &sun));
+	address_destroy(address);
+
+	snprintf(url, sizeof(url), "unix:/%0*d", (int)sizeof(sun.sun_path) - 2, 0);
+	address = address_create(url);
+	CHECK(address_get_unix(address, &sun) == sizeof(sun));
+	address_destroy(address);
+
+	address = address_create("tcp:127.0.0.1:7000");
+	CHECK(address && !address_get_unix(address, &sun));
+	address_destroy(address);
+
+	CHECK(!address_create("unix:"));
+}
+
+static void check_unix_serve(const char* url) {
+
+	// the server built with this check binds url and answers kernel stats
+	pid_t pid = fork();
+	if (!pid) {
+		execl("./vmixer", "vmixer", "-b", url, "-m", "0", (char*)NULL);
+		_exit(127);
+	}
+
+	CHECK(pid > 0);
+	if (pid <= 0)
+		return;
+
+	client_t* client = NULL;
+	int tries;
+	for (tries = 0; !client && tries < 50; tries ++)
+		if (!(client = client_create(url)))
+			usleep(100000);
+
+	CHECK(client);
+	if (client) {
+		json_node_t* answer = NULL;
+		CHECK(!client_request(client, NULL, NULL, "stats", NULL, &answer));
+
+		json_node_t* connections = json_node_object_node(answer, "connections", JSON_NODE_TYPE_OBJECT);
+		json_node_t* current = json_node_object_node(connections, "current", JSON_NODE_TYPE_INTEGER);
+		CHECK(current && json_node_int_value(current) == 1);
+		json_node_destroy(answer);
+
+		// pipelined path over the same socket
+		unsigned int id, got;
+		CHECK(!client_send(client, NULL, NULL, "accept", NULL, &id));
+		CHECK(!client_recv(client, &got, &answer) && got == id);
+		CHECK(json_node_object_node(answer, "accepted", JSON_NODE_TYPE_ANY));
+		json_node_destroy(answer);
+
+		// request in between keeps its own answer, the pipelined one is left for client_recv
+		CHECK(!client_send(client, NULL, NULL, "accept", NULL, &id));
+		CHECK(!client_request(client, NULL, NULL, "stats", NULL, &answer));
+		CHECK(json_node_object_node(answer, "connections", JSON_NODE_TYPE_OBJECT));
+		json_node_destroy(answer);
+		CHECK(!client_recv(client, &got, &answer) && got == id);
+		CHECK(json_node_object_node(answer, "accepted", JSON_NODE_TYPE_INTEGER));
+		json_node_destroy(answer);
+
+		client_destroy(client);
+	}
+
+	int status = -1;
+	kill(pid, SIGTERM);
+	CHECK(waitpid(pid, &status, 0) == pid && WIFEXITED(status) && !WEXITSTATUS(status));
+}
+
+static void check_unix(void) {
+#ifdef ENABLE_UNIX
+	char url[64];
+	snprintf(url, sizeof(url), "unix:/tmp/vmixer-check-%d.sock", (int)getpid());
+	check_unix_serve(url);
+	unlink(&url[strlen("unix:")]);
+
+	snprintf(url, sizeof(url), "unix:@vmixer-check-%d", (int)getpid());
+	check_unix_serve(url);
+#endif
+}
+
+typedef struct {
+
+	char str[256];
+	int len;
+} check_out_t;
+
+static int check_out_write(void* data, const char* str, int len) {
+
+	check_out_t* out = data;
+	if (out->len + len >= (int) sizeof(out->str))
+		return -1;
+
+	memcpy(&out->str[out->len], str, len);
+	out->len += len;
+	out->str[out->len] = '\0';
+	return 0;
+}
+
+static void check_cursor(void) {
+
+	parser_t* parser = parser_create();
+	CHECK(parser);
+
+	const char* docs[] = { "{\"a\":[1,{},[]],\"b\":{\"c\":\"d\",\"e\":NULL},\"f\":TRUE}", "[[],[[]],{}]", "\"one\"", NULL };
+	int id;
+	for (id = 0; docs[id]; id ++) {
+		json_node_t* node = parser_parse_string(parser, docs[id]);
+		CHECK(node);
+
+		check_out_t whole = { "", 0 };
+		CHECK(!json_node_write(node, JSON_STYLE_MINIMAL, check_out_write, &whole));
+
+		// one value per call, parts put together give the whole print
+		check_out_t parts = { "", 0 };
+		json_cursor_t* cursor = json_cursor_create(node, JSON_STYLE_MINIMAL);
+		CHECK(cursor);
+
+		int res, calls = 0;
+		while ((res = json_cursor_write(cursor, 1, check_out_write, &parts)) == 1)
+			calls ++;
+
+		CHECK(!res && parts.len == whole.len && !strcmp(parts.str, whole.str));
+		CHECK(id == 2 ? !calls : calls > 1);
+		json_cursor_destroy(cursor);
+		json_node_destroy(node);
+	}
+
+	// a cursor left in the middle is destroyed with its iterators
+	json_node_t* node = parser_parse_string(parser, docs[0]);
+	json_cursor_t* cursor = json_cursor_create(node, JSON_STYLE_MINIMAL);
+	check_out_t part = { "", 0 };
+	CHECK(json_cursor_write(cursor, 1, check_out_write, &part) == 1);
+	json_cursor_destroy(cursor);
+	json_node_destroy(node);
+
+	parser_destroy(parser);
+}
+
+static void check_json_long(void) {
+
+	parser_t* parser = parser_create();
+	CHECK(parser);
+
+	// 64 bit counters keep their value through print and parse
+	json_node_t* node = json_node_array(NULL);
+	json_node_array_add(node, json_node_long(6000000000LL));
+	json_node_array_add(node, json_node_int(-1));
+
+	check_out_t out = { "", 0 };
+	CHECK(!json_node_write(node, JSON_STYLE_MINIMAL, check_out_write, &out));
+	CHECK(!strcmp(out.str, "[6000000000,-1]"));
+	json_node_destroy(node);
+
+	node = parser_parse_string(parser, out.str);
+	CHECK(json_node_type(json_node_array_node(node, 0)) == JSON_NODE_TYPE_INTEGER);
+	check_out_t back = { "", 0 };
+	CHECK(!json_node_write(node, JSON_STYLE_MINIMAL, check_out_write, &back));
+	CHECK(!strcmp(back.str, out.str));
+	json_node_destroy(node);
+
+	parser_destroy(parser);
+}
+
+int main(int argc, char* argv[]) {
+
+	check_framer_codec();
+	check_framer_feed();
+	check_wheels();
+	check_cursor();
+	check_json_long();
+	check_shmrng();
+	check_address_unix();
+	check_unix();
+
+	if (failed)
+		fprintf(stderr, "%d checks failed\n", failed);
+
+	return failed ? 1 : 0;
+}
@@ -1,9 +1,12 @@
 
 #include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/un.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
@@ -14,6 +17,10 @@
 #include "thread.h"
 #include "vector.h"
 #include "client.h"
+#include "framer.h"
+#include "shmrng.h"
+
+#define DGRAM_TIMEOUT 1
 
 typedef struct cluster_node_s cluster_node_t;
 
@@ -30,15 +37,60 @@ struct cluster_s {
 	vector_t* vector;
 };
 
+typedef struct client_chunk_s client_chunk_t;
+typedef struct client_event_s client_event_t;
+
+struct client_chunk_s {
+
+	client_t* client;
+	uint32_t flags;
+	uint32_t id;
+	uint32_t used;
+	uint32_t total;
+	char buffer[IO_BUFFER_SIZE];
+};
+
+// frame read while another one was awaited, pushed ones are kept for client_event, answers for client_recv
+struct client_event_s {
+
+	char* buffer;
+	uint32_t size;
+	uint32_t id;
+	client_event_t* next;
+};
+
 struct client_s {
 
 	int sock;
+	uint32_t id;
+	int timeout;
+
+	// kept by the server connection, both are lost when the stream is reconnected,
+	// pipelined counts requests whose answers are not readed yet
+	uint32_t pipelined;
+	uint32_t subscribed;
+
+	struct {
+		client_event_t* head;
+		client_event_t* tail;
+	} event, answer;
 
 	parser_t* parser;
+	framer_t* framer;
+	shmrng_t* shm;
 	address_t* address;
 	cluster_t* cluster;
 };
 
+static int client_shm(address_t* address) {
+
+#ifdef ENABLE_SHM
+	if (!strcmp(address_get_proto(address), "shm"))
+		return !0;
+#endif
+	return 0;
+}
+
 int client_connect(address_t* address) {
 
 	int sock;
@@ -74,27 +126,36 @@ int client_connect(address_t* address) {
 	}
 #endif
 #ifdef ENABLE_UNIX
-	if (!strcmp(address_get_proto(address), "unix")) {
-		struct sockaddr_un srv = { 0 };
-		srv.sun_family = AF_UNIX;
-		snprintf(srv.sun_path, sizeof(srv.sun_path), "%s", address_get_host(address));
+	if (!strcmp(address_get_proto(address), "unix") || client_shm(address)) {
+		struct sockaddr_un srv;
+		socklen_t socksize = address_get_unix(address, &srv);
+		if (!socksize) {
+			ERROR("connect to \"%s\": %s", address_get_url(address), strerror(ENAMETOOLONG));
+			return -1;
+		}
+
 		if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {}
-		int optarg = 1;
-		setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &optarg, sizeof(optarg));
-		if (connect(sock, (struct sockaddr *)&srv, sizeof(struct sockaddr))) {
+		if (connect(sock, (struct sockaddr *)&srv, socksize)) {
 			ERROR("connect to \"%s\": %s", address_get_url(address), strerror(errno));
+			close(sock);
 			return -1;
 		}
 	}
 #endif
 #ifdef ENABLE_UDP
 	if (!strcmp(address_get_proto(address), "udp")) {
-		struct sockaddr_un srv = { 0 };
-		srv.sun_family = AF_UNIX;
-		snprintf(srv.sun_path, sizeof(srv.sun_path), "%s", address_get_host(address));
-		if ((sock = socket(AF_UNIX, SOCK_DGRAM, 0)) == -1) {}
-		int optarg = 1;
-		setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &optarg, sizeof(optarg));
+		struct sockaddr_in srv = { 0 };
+		srv.sin_family = AF_INET;
+		srv.sin_port = htons(address_get_port(address));
+		inet_pton(AF_INET, address_get_host(address), &srv.sin_addr.s_addr);
+		if ((sock = socket(AF_INET, SOCK_DGRAM, 0)) == -1) {}
+		struct timeval timeout = { .tv_sec = DGRAM_TIMEOUT, .tv_usec = 0 };
+		setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		if (connect(sock, (struct sockaddr *)&srv, sizeof(struct sockaddr))) {
+			ERROR("connect to \"%s\": %s", address_get_url(address), strerror(errno));
+			close(sock);
+			return -1;
+		}
 	}
 #endif
 
@@ -124,6 +185,20 @@ client_t* client_create(const char* url) {
 			client_destroy(client);
 			return NULL;
 		}
+
+		// shm clients exchange frames through rings passed over the unix socket
+		if (client_shm(client->address)) {
+			if (!(client->shm = shmrng_connect(client->sock))) {
+				ERROR("connect to \"%s\": shared memory ring not passed", url);
+				client_destroy(client);
+				return NULL;
+			}
+		}
+
+		else if (!(client->framer = framer_create(client->sock))) {
+			client_destroy(client);
+			return NULL;
+		}
 	}
 
 	return client;
@@ -137,130 +212,611 @@ void client_destroy(void* data) {
 			close(client->sock);
 		address_destroy(client->address);
 		parser_destroy(client->parser);
+		framer_destroy(client->framer);
+		shmrng_destroy(client->shm);
+		while (client->event.head) {
+			client_event_t* event = client->event.head;
+			client->event.head = event->next;
+			free(event->buffer);
+			free(event);
+		}
+		while (client->answer.head) {
+			client_event_t* answer = client->answer.head;
+			client->answer.head = answer->next;
+			free(answer->buffer);
+			free(answer);
+		}
 		free(data);
 	}
 }
 
-int client_request(client_t* client, const char* module, const char* thread, const char* method, json_node_t* args, json_node_t* *answer) {
+static int client_stream(client_t* client) {
 
-	if (!client || !answer)
+#ifdef ENABLE_TCP
+	if (!strcmp(address_get_proto(client->address), "tcp"))
+		return !0;
+#endif
+#ifdef ENABLE_SCTP
+	if (!strcmp(address_get_proto(client->address), "sctp"))
+		return !0;
+#endif
+#ifdef ENABLE_UNIX
+	if (!strcmp(address_get_proto(client->address), "unix"))
+		return !0;
+#endif
+#ifdef ENABLE_SHM
+	if (!strcmp(address_get_proto(client->address), "shm"))
+		return !0;
+#endif
+#ifdef ENABLE_LOCAL
+	if (!strcmp(address_get_proto(client->address), "local"))
+		return !0;
+#endif
+	return 0;
+}
+
+static int client_dgram(client_t* client) {
+
+#ifdef ENABLE_UDP
+	if (!strcmp(address_get_proto(client->address), "udp"))
+		return !0;
+#endif
+	return 0;
+}
+
+static int client_write(client_t* client, uint32_t flags, uint32_t id, const char* buffer, uint32_t size) {
+
+	if (!client->shm && !client->framer)
 		return THREAD_METHOD_ERROR;
 
-	json_node_t* request = json_node_object(NULL);
-	json_node_object_add(request, "target", json_node_object(NULL));
-	json_node_object_add(request, "args"  , args);
-	json_node_object_add(json_node_object_node(request, "target", JSON_NODE_TYPE_OBJECT), "module", json_node_string(module));
-	json_node_object_add(json_node_object_node(request, "target", JSON_NODE_TYPE_OBJECT), "thread", json_node_string(thread));
-	json_node_object_add(json_node_object_node(request, "target", JSON_NODE_TYPE_OBJECT), "method", json_node_string(method));
+	uint32_t hsize = HEADER_MSG_SIZE + ((flags & FRAME_FLAG_ID) ? FRAME_ID_SIZE : 0);
+
+	// chunked messages do not fit datagrams
+	if (client_dgram(client) && (hsize + size > FRAME_DATAGRAM_SIZE || (flags & FRAME_FLAG_MORE)))
+		return THREAD_METHOD_ERROR;
+
+	if (client->shm) {
+		if (shmrng_write(client->shm, flags, id, buffer, size))
+			return THREAD_METHOD_ERROR;
+	}
+
+	else if (framer_write(client->framer, flags, id, buffer, size))
+		return THREAD_METHOD_ERROR;
+
+	return THREAD_METHOD_OK;
+}
+
+static int client_chunk(client_chunk_t* chunk, uint32_t more) {
+
+	int res = client_write(chunk->client, chunk->flags | more, chunk->id, chunk->buffer, chunk->used);
+	chunk->used = 0;
+	return res;
+}
+
+static int client_chunk_write(void* data, const char* str, int len) {
+
+	client_chunk_t* chunk = data;
+	if ((chunk->total += len) > IO_MESSAGE_SIZE)
+		return -1;
+
+	while (len) {
+		// the last chunk is sent by client_message without FRAME_FLAG_MORE
+		if (chunk->used == IO_BUFFER_SIZE && client_chunk(chunk, FRAME_FLAG_MORE))
+			return -1;
 
-	char buffer[IO_BUFFER_SIZE]; buffer[0] = '\0';
-	int size = IO_BUFFER_SIZE;
+		int part = IO_BUFFER_SIZE - chunk->used;
+		if (part > len)
+			part = len;
 
-	if (json_node_print(request, JSON_STYLE_MINIMAL, &size, buffer)) {
-		json_node_destroy(request);
+		memcpy(&chunk->buffer[chunk->used], str, part);
+		chunk->used += part;
+		str += part;
+		len -= part;
+	}
+
+	return 0;
+}
+
+static int client_message(client_t* client, uint32_t flags, uint32_t id, const char* module, const char* thread, const char* method, uint32_t handle, json_node_t* args) {
+
+	client_chunk_t* chunk = malloc(sizeof(*chunk));
+	if (!chunk)
 		return THREAD_METHOD_ERROR;
+
+	chunk->client = client;
+	chunk->flags = flags;
+	chunk->id = id;
+	chunk->used = chunk->total = 0;
+
+	json_node_t* target = json_node_object(NULL);
+	if (module)
+		json_node_object_add(target, "module", json_node_string(module));
+	if (thread)
+		json_node_object_add(target, "thread", json_node_string(thread));
+	if (method)
+		json_node_object_add(target, "method", json_node_string(method));
+
+	// args stay owned by caller, so the envelope is written around it
+	int res;
+	char head[64];
+	if (client->timeout)
+		snprintf(head, sizeof(head), "{\"deadline\":%d,", client->timeout);
+	else	snprintf(head, sizeof(head), "{");
+	res = client_chunk_write(chunk, head, strlen(head));
+
+	if (!res && handle) {
+		snprintf(head, sizeof(head), "\"handle\":%u", handle);
+		res = client_chunk_write(chunk, head, strlen(head));
 	}
 
-	size = IO_BUFFER_SIZE - size;
+	else if (!res) {
+		res = client_chunk_write(chunk, "\"target\":", strlen("\"target\":"));
+		if (!res)
+			res = json_node_write(target, JSON_STYLE_MINIMAL, client_chunk_write, chunk);
+	}
 
-	if (!strcmp(address_get_proto(client->address), "tcp")) {
-#ifdef ENABLE_TCP
-		if (write(client->sock, &size, HEADER_MSG_SIZE) != HEADER_MSG_SIZE)
-			return THREAD_METHOD_ERROR;
+	if (!res && args) {
+		res = client_chunk_write(chunk, ",\"args\":", strlen(",\"args\":"));
+		if (!res)
+			res = json_node_write(args, JSON_STYLE_MINIMAL, client_chunk_write, chunk);
+	}
 
-		if (write(client->sock, buffer, size) != size)
-			return THREAD_METHOD_ERROR;
+	if (!res)
+		res = client_chunk_write(chunk, "}", strlen("}"));
+
+	if (!res)
+		res = client_chunk(chunk, 0);
+
+	json_node_destroy(target);
+	free(chunk);
+	return res ? THREAD_METHOD_ERROR : THREAD_METHOD_OK;
+}
+
+static int client_batch_message(client_t* client, uint32_t flags, uint32_t id, json_node_t* requests, int parallel) {
+
+	client_chunk_t* chunk = malloc(sizeof(*chunk));
+	if (!chunk)
+		return THREAD_METHOD_ERROR;
+
+	chunk->client = client;
+	chunk->flags = flags;
+	chunk->id = id;
+	chunk->used = chunk->total = 0;
+
+	// plain array runs in order on one thread, envelope lets the server spread it over workers or carries deadline
+	char head[64];
+	if (client->timeout)
+		snprintf(head, sizeof(head), "{\"deadline\":%d,\"parallel\":%s,\"batch\":", client->timeout, parallel ? "true" : "false");
+	else	snprintf(head, sizeof(head), "%s", parallel ? "{\"parallel\":true,\"batch\":" : "");
+	const char* tail = parallel || client->timeout ? "}" : "";
+
+	int res = client_chunk_write(chunk, head, strlen(head));
+
+	if (!res)
+		res = json_node_write(requests, JSON_STYLE_MINIMAL, client_chunk_write, chunk);
+
+	if (!res)
+		res = client_chunk_write(chunk, tail, strlen(tail));
+
+	if (!res)
+		res = client_chunk(chunk, 0);
+
+	free(chunk);
+	return res ? THREAD_METHOD_ERROR : THREAD_METHOD_OK;
+}
 
-		if (read(client->sock, &size, HEADER_MSG_SIZE) != HEADER_MSG_SIZE)
+// request ids skip FRAME_PUSH_ID, so pushed frames are never taken for answers
+static uint32_t client_next(client_t* client) {
+
+	if (++ client->id == FRAME_PUSH_ID)
+		++ client->id;
+	return client->id;
+}
+
+static int client_read(client_t* client, uint32_t* id, char** buffer, uint32_t* size, int* push) {
+
+	*buffer = NULL;
+	*size = 0;
+	*id = 0;
+	*push = 0;
+
+	if (client_dgram(client)) {
+		char* data = malloc(FRAME_DATAGRAM_SIZE);
+		if (!data)
 			return THREAD_METHOD_ERROR;
 
-		int readed = 0;
-		while (readed != size) {
-			int msgsize = read(client->sock, &buffer[readed], size - readed);
-			if (msgsize <= 0)
-				break;
-			readed += msgsize;
+		uint32_t len = 0, hsize = HEADER_MSG_SIZE;
+		int msgsize = recv(client->sock, data, FRAME_DATAGRAM_SIZE, 0);
+		if (msgsize >= HEADER_MSG_SIZE) {
+			memcpy(&len, data, HEADER_MSG_SIZE);
+			hsize += (len & FRAME_FLAG_ID) ? FRAME_ID_SIZE : 0;
 		}
 
-		if (readed != size)
+		if (msgsize < (int)hsize || (len & FRAME_SIZE_MASK) != msgsize - hsize || (len & FRAME_FLAG_MORE)) {
+			free(data);
 			return THREAD_METHOD_ERROR;
+		}
 
-		*answer = parser_parse_buffer(client->parser, buffer, size);
-#else
-		*answer = json_node_object(NULL);
-		json_node_object_add(*answer, "error", json_node_string("protocol not compiled"));
-		return THREAD_METHOD_ERROR;
-#endif
+		if (len & FRAME_FLAG_ID) {
+			memcpy(id, &data[HEADER_MSG_SIZE], FRAME_ID_SIZE);
+			*push = *id == FRAME_PUSH_ID;
+		}
+
+		*size = len & FRAME_SIZE_MASK;
+		memmove(data, &data[hsize], *size);
+		*buffer = data;
+		return THREAD_METHOD_OK;
 	}
-	if (!strcmp(address_get_proto(client->address), "udp")) {
-#ifdef ENABLE_UDP
-		//send json_node via client_t*
-		//recv json_node via client_t*
-#else
-		*answer = json_node_object(NULL);
-		json_node_object_add(*answer, "error", json_node_string("protocol not compiled"));
+
+	while (client->shm || client->framer) {
+		uint32_t flags, part;
+		const char* data;
+		if (client->shm ? shmrng_read(client->shm, &flags, id, &data, &part) : framer_read(client->framer, &flags, id, &data, &part))
+			break;
+
+		if (*size + part > IO_MESSAGE_SIZE)
+			break;
+
+		char* message = realloc(*buffer, *size + part + 1);
+		if (!message)
+			break;
+
+		*buffer = message;
+		memcpy(&message[*size], data, part);
+		*size += part;
+
+		// chunks are collected until the whole answer is readed
+		if (!(flags & FRAME_FLAG_MORE)) {
+			*push = (flags & FRAME_FLAG_ID) && *id == FRAME_PUSH_ID;
+			return THREAD_METHOD_OK;
+		}
+	}
+
+	free(*buffer);
+	*buffer = NULL;
+	return THREAD_METHOD_ERROR;
+}
+
+static int client_queue(client_t* client, int push, uint32_t id, char* buffer, uint32_t size) {
+
+	client_event_t* event = malloc(sizeof(*event));
+	if (!event) {
+		free(buffer);
 		return THREAD_METHOD_ERROR;
-#endif
 	}
-	if (!strcmp(address_get_proto(client->address), "local")) {
-#ifdef ENABLE_LOCAL
-		if (write(client->sock, &size, HEADER_MSG_SIZE) != HEADER_MSG_SIZE)
+
+	event->buffer = buffer;
+	event->size = size;
+	event->id = id;
+	event->next = NULL;
+
+	if (!push) {
+		if (client->answer.tail)
+			client->answer.tail->next = event;
+		else	client->answer.head = event;
+		client->answer.tail = event;
+		client->pipelined --;
+		return THREAD_METHOD_OK;
+	}
+
+	if (client->event.tail)
+		client->event.tail->next = event;
+	else	client->event.head = event;
+	client->event.tail = event;
+	return THREAD_METHOD_OK;
+}
+
+static int client_dequeue(client_t* client, int push, uint32_t* id, char** buffer, uint32_t* size) {
+
+	client_event_t* queued = push ? client->event.head : client->answer.head;
+	if (!queued)
+		return THREAD_METHOD_ERROR;
+
+	if (push && !(client->event.head = queued->next))
+		client->event.tail = NULL;
+
+	if (!push && !(client->answer.head = queued->next))
+		client->answer.tail = NULL;
+
+	*buffer = queued->buffer;
+	*size = queued->size;
+	if (id)
+		*id = queued->id;
+	free(queued);
+	return THREAD_METHOD_OK;
+}
+
+// reads next frame that is not pushed, pushed ones are queued on the way
+static int client_frame(client_t* client, uint32_t* id, char** buffer, uint32_t* size) {
+
+	int push;
+	while (1) {
+		if (client_read(client, id, buffer, size, &push))
 			return THREAD_METHOD_ERROR;
 
-		if (write(client->sock, buffer, size) != size)
+		if (!push)
+			return THREAD_METHOD_OK;
+
+		if (client_queue(client, push, *id, *buffer, *size))
 			return THREAD_METHOD_ERROR;
+	}
+}
+
+// answer not readed in time may still come, the stream is replaced so it is not taken for the next answer
+static void client_reclaim(client_t* client) {
+
+	WARN("request to \"%s\" timed out after %d ms, reconnecting", address_get_url(client->address), client->timeout);
+
+	if (client->pipelined || client->subscribed)
+		WARN("%u pipelined requests and %u subscriptions to \"%s\" are lost", client->pipelined, client->subscribed, address_get_url(client->address));
+
+	client->pipelined = client->subscribed = 0;
 
-		if (read(client->sock, &size, HEADER_MSG_SIZE) != HEADER_MSG_SIZE)
+	framer_destroy(client->framer);
+	client->framer = NULL;
+	shmrng_destroy(client->shm);
+	client->shm = NULL;
+	close(client->sock);
+
+	if ((client->sock = client_connect(client->address)) == -1)
+		return;
+
+	if (client_shm(client->address))
+		client->shm = shmrng_connect(client->sock);
+	else	client->framer = framer_create(client->sock);
+
+	client_timeout(client, client->timeout);
+}
+
+static int client_answer(client_t* client, uint32_t id, json_node_t* *answer) {
+
+	char* buffer;
+	uint32_t size, answered;
+
+	while (1) {
+		if (client_frame(client, &answered, &buffer, &size)) {
+			if ((client->framer || client->shm) && client->timeout && !client_dgram(client) && (errno == EAGAIN || errno == EWOULDBLOCK))
+				client_reclaim(client);
 			return THREAD_METHOD_ERROR;
+		}
+
+		// answers are matched by request id, ones of pipelined requests are kept for client_recv,
+		// late datagrams of requests given up on are dropped
+		if (answered == id)
+			break;
 
-		int readed = 0;
-		while (readed != size) {
-			int msgsize = read(client->sock, &buffer[readed], size - readed);
-			if (msgsize <= 0)
-				break;
-			readed += msgsize;
+		if (client->pipelined) {
+			if (client_queue(client, 0, answered, buffer, size))
+				return THREAD_METHOD_ERROR;
 		}
 
-		if (readed != size)
-			return THREAD_METHOD_ERROR;
+		else	free(buffer);
+	}
+
+	*answer = parser_parse_buffer(client->parser, buffer, size);
+	free(buffer);
+	return THREAD_METHOD_OK;
+}
+
+int client_timeout(client_t* client, int timeout) {
+
+	if (!client || timeout < 0)
+		return THREAD_METHOD_ERROR;
 
-		*answer = parser_parse_buffer(client->parser, buffer, size);
-#else
+	client->timeout = timeout;
+
+	// shared memory ring waits on a futex, the socket only tells the peer is gone
+	if (client->shm) {
+		shmrng_timeout(client->shm, timeout);
+		return THREAD_METHOD_OK;
+	}
+
+	struct timeval tv = { .tv_sec = timeout / 1000, .tv_usec = (timeout % 1000) * 1000 };
+	if (!timeout && client_dgram(client))
+		tv.tv_sec = DGRAM_TIMEOUT;
+
+	if (setsockopt(client->sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)))
+		return THREAD_METHOD_ERROR;
+
+	return THREAD_METHOD_OK;
+}
+
+int client_request(client_t* client, const char* module, const char* thread, const char* method, json_node_t* args, json_node_t* *answer) {
+
+	if (!client || !answer)
+		return THREAD_METHOD_ERROR;
+
+	if (!client_stream(client) && !client_dgram(client)) {
 		*answer = json_node_object(NULL);
 		json_node_object_add(*answer, "error", json_node_string("protocol not compiled"));
 		return THREAD_METHOD_ERROR;
-#endif
 	}
-	if (!strcmp(address_get_proto(client->address), "sctp")) {
-#ifdef ENABLE_SCTP
-		if (write(client->sock, &size, HEADER_MSG_SIZE) != HEADER_MSG_SIZE)
-			return THREAD_METHOD_ERROR;
 
-		if (write(client->sock, buffer, size) != size)
-			return THREAD_METHOD_ERROR;
+	uint32_t id = client_next(client);
+	if (client_message(client, FRAME_FLAG_ID, id, module, thread, method, 0, args))
+		return THREAD_METHOD_ERROR;
 
-		if (read(client->sock, &size, HEADER_MSG_SIZE) != HEADER_MSG_SIZE)
-			return THREAD_METHOD_ERROR;
+	return client_answer(client, id, answer);
+}
 
-		int readed = 0;
-		while (readed != size) {
-			int msgsize = read(client->sock, &buffer[readed], size - readed);
-			if (msgsize <= 0)
-				break;
-			readed += msgsize;
-		}
+int client_resolve(client_t* client, const char* module, const char* thread, const char* method, unsigned int* handle) {
 
-		if (readed != size)
-			return THREAD_METHOD_ERROR;
+	if (!client || !module || !thread || !method || !handle)
+		return THREAD_METHOD_ERROR;
+
+	json_node_t* args = json_node_object(NULL);
+	json_node_object_add(args, "module", json_node_string(module));
+	json_node_object_add(args, "thread", json_node_string(thread));
+	json_node_object_add(args, "method", json_node_string(method));
 
-		*answer = parser_parse_buffer(client->parser, buffer, size);
-#else
+	json_node_t* answer = NULL;
+	int res = client_request(client, NULL, NULL, "resolve", args, &answer);
+	json_node_destroy(args);
+
+	json_node_t* value = json_node_object_node(answer, "handle", JSON_NODE_TYPE_INTEGER);
+	if (res || !value)
+		res = THREAD_METHOD_ERROR;
+	else	*handle = json_node_int_value(value);
+
+	json_node_destroy(answer);
+	return res;
+}
+
+int client_handle_request(client_t* client, unsigned int handle, json_node_t* args, json_node_t* *answer) {
+
+	if (!client || !handle || !answer)
+		return THREAD_METHOD_ERROR;
+
+	if (!client_stream(client) && !client_dgram(client)) {
 		*answer = json_node_object(NULL);
 		json_node_object_add(*answer, "error", json_node_string("protocol not compiled"));
 		return THREAD_METHOD_ERROR;
-#endif
 	}
 
+	uint32_t id = client_next(client);
+	if (client_message(client, FRAME_FLAG_ID, id, NULL, NULL, NULL, handle, args))
+		return THREAD_METHOD_ERROR;
+
+	return client_answer(client, id, answer);
+}
+
+int client_batch(client_t* client, json_node_t* requests, int parallel, json_node_t* *answers) {
+
+	if (!client || !answers || json_node_type(requests) != JSON_NODE_TYPE_ARRAY)
+		return THREAD_METHOD_ERROR;
+
+	if (!client_stream(client) && !client_dgram(client)) {
+		*answers = json_node_object(NULL);
+		json_node_object_add(*answers, "error", json_node_string("protocol not compiled"));
+		return THREAD_METHOD_ERROR;
+	}
+
+	uint32_t id = client_next(client);
+	if (client_batch_message(client, FRAME_FLAG_ID, id, requests, parallel))
+		return THREAD_METHOD_ERROR;
+
+	return client_answer(client, id, answers);
+}
+
+int client_batch_add(json_node_t* requests, const char* module, const char* thread, const char* method, json_node_t* args) {
+
+	if (json_node_type(requests) != JSON_NODE_TYPE_ARRAY)
+		return THREAD_METHOD_ERROR;
+
+	json_node_t* request = json_node_object(NULL);
+	json_node_t* target = json_node_object(NULL);
+	json_node_object_add(target, "module", json_node_string(module));
+	json_node_object_add(target, "thread", json_node_string(thread));
+	json_node_object_add(target, "method", json_node_string(method));
+	json_node_object_add(request, "target", target);
+	if (args)
+		json_node_object_add(request, "args", args);
+
+	return json_node_array_add(requests, request) ? THREAD_METHOD_ERROR : THREAD_METHOD_OK;
+}
+
+int client_send(client_t* client, const char* module, const char* thread, const char* method, json_node_t* args, unsigned int* id) {
+
+	if (!client || !id || (!client_stream(client) && !client_dgram(client)))
+		return THREAD_METHOD_ERROR;
+
+	*id = client_next(client);
+	if (client_message(client, FRAME_FLAG_ID, *id, module, thread, method, 0, args))
+		return THREAD_METHOD_ERROR;
+
+	client->pipelined ++;
+	return THREAD_METHOD_OK;
+}
+
+int client_recv(client_t* client, unsigned int* id, json_node_t* *answer) {
+
+	if (!client || !id || !answer || (!client_stream(client) && !client_dgram(client)))
+		return THREAD_METHOD_ERROR;
+
+	char* buffer;
+	uint32_t size;
+
+	// answers readed while another frame was awaited come first
+	if (!client_dequeue(client, 0, id, &buffer, &size))
+		;
+
+	// answers of requests sent before a reconnect never come
+	else if (client_stream(client) && !client->pipelined)
+		return THREAD_METHOD_ERROR;
+
+	else if (client_frame(client, id, &buffer, &size))
+		return THREAD_METHOD_ERROR;
+
+	else if (client->pipelined)
+		client->pipelined --;
+
+	*answer = parser_parse_buffer(client->parser, buffer, size);
+	free(buffer);
+	return THREAD_METHOD_OK;
+}
+
+int client_subscribe(client_t* client, const char* module, const char* thread, unsigned int* subscription) {
+
+	if (!client || !subscription)
+		return THREAD_METHOD_ERROR;
+
+	json_node_t* args = json_node_object(NULL);
+	if (module)
+		json_node_object_add(args, "module", json_node_string(module));
+	if (thread)
+		json_node_object_add(args, "thread", json_node_string(thread));
+
+	json_node_t* answer = NULL;
+	int res = client_request(client, NULL, NULL, "subscribe", args, &answer);
+	json_node_destroy(args);
+
+	json_node_t* value = json_node_object_node(answer, "subscription", JSON_NODE_TYPE_INTEGER);
+	if (res || !value)
+		res = THREAD_METHOD_ERROR;
+
+	else {
+		*subscription = json_node_int_value(value);
+		client->subscribed ++;
+	}
+
+	json_node_destroy(answer);
+	return res;
+}
+
+int client_event(client_t* client, json_node_t* *event) {
+
+	if (!client || !event || !client_stream(client))
+		return THREAD_METHOD_ERROR;
+
+	char* buffer;
+	uint32_t size, id;
+	int push = 0;
+
+	if (!client_dequeue(client, 1, NULL, &buffer, &size))
+		;
+
+	// subscriptions are gone with the stream they were made on
+	else if (!client->subscribed)
+		return THREAD_METHOD_ERROR;
+
+	else while (!push) {
+		if (client_read(client, &id, &buffer, &size, &push))
+			return THREAD_METHOD_ERROR;
+
+		// answers of pipelined requests are kept for client_recv
+		if (push)
+			;
+
+		else if (client->pipelined) {
+			if (client_queue(client, push, id, buffer, size))
+				return THREAD_METHOD_ERROR;
+		}
+
+		else	free(buffer);
+	}
+
+	*event = parser_parse_buffer(client->parser, buffer, size);
+	free(buffer);
 	return THREAD_METHOD_OK;
 }
 
@@ -273,13 +829,17 @@ int client_file_request(client_t* client, const char* file, json_node_t* *answer
 	if (!request)
 		return THREAD_METHOD_ERROR;
 
-	return client_request(client,
+	// args are written out of the parsed document, it stays owned here
+	int res = client_request(client,
 		json_node_string_value(json_node_object_node(request, "module", JSON_NODE_TYPE_STRING)),
 		json_node_string_value(json_node_object_node(request, "thread", JSON_NODE_TYPE_STRING)),
 		json_node_string_value(json_node_object_node(request, "method", JSON_NODE_TYPE_STRING)),
 		json_node_object_node(request, "args", JSON_NODE_TYPE_OBJECT),
 		answer
 	);
+
+	json_node_destroy(request);
+	return res;
 }
 
 cluster_t* cluster_create() {
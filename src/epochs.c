@@ -0,0 +1,203 @@
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "epochs.h"
+
+#define EPOCHS_LINE 64
+#define EPOCHS_SPINS 128
+
+typedef struct epochs_slot_s epochs_slot_t;
+typedef struct epochs_retired_s epochs_retired_t;
+
+// every reader thread writes only to its own cacheline
+struct epochs_slot_s {
+
+	uint64_t epoch;
+	int nest;
+	int used;
+	epochs_slot_t* next;
+} __attribute__((aligned(EPOCHS_LINE)));
+
+// pointer retired by epochs_retire, freed once readers of its epoch are gone
+struct epochs_retired_s {
+
+	void* data;
+	void (*destroy)(void*);
+	uint64_t epoch;
+	epochs_retired_t* next;
+};
+
+static uint64_t epochs_global = 1;
+static epochs_slot_t* epochs_slots = NULL;
+
+static pthread_mutex_t epochs_mutex = PTHREAD_MUTEX_INITIALIZER;
+static epochs_retired_t* epochs_retired = NULL;
+
+static pthread_key_t epochs_key;
+static pthread_once_t epochs_once = PTHREAD_ONCE_INIT;
+static __thread epochs_slot_t* epochs_self = NULL;
+
+static void epochs_release(void* data) {
+
+	epochs_slot_t* slot = data;
+	__atomic_store_n(&slot->epoch, 0, __ATOMIC_RELEASE);
+	__atomic_store_n(&slot->used, 0, __ATOMIC_RELEASE);
+}
+
+static void epochs_init() {
+
+	pthread_key_create(&epochs_key, epochs_release);
+}
+
+static epochs_slot_t* epochs_slot() {
+
+	if (epochs_self)
+		return epochs_self;
+
+	pthread_once(&epochs_once, epochs_init);
+
+	// slots of finished threads are reused, slots are never freed
+	epochs_slot_t* slot;
+	for (slot = __atomic_load_n(&epochs_slots, __ATOMIC_ACQUIRE); slot; slot = slot->next) {
+		if (!__atomic_load_n(&slot->used, __ATOMIC_RELAXED) && !__atomic_exchange_n(&slot->used, 1, __ATOMIC_ACQ_REL))
+			break;
+	}
+
+	if (!slot) {
+		if (posix_memalign((void**)&slot, EPOCHS_LINE, sizeof(*slot)))
+			abort();
+
+		slot->epoch = 0;
+		slot->nest = 0;
+		slot->used = 1;
+		slot->next = __atomic_load_n(&epochs_slots, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&epochs_slots, &slot->next, slot, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	}
+
+	pthread_setspecific(epochs_key, slot);
+	return epochs_self = slot;
+}
+
+void epochs_enter() {
+
+	epochs_slot_t* slot = epochs_slot();
+	if (slot->nest ++)
+		return;
+
+	__atomic_store_n(&slot->epoch, __atomic_load_n(&epochs_global, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+	// pairs with the fence in epochs_synchronize, the epoch is visible before any load
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void epochs_leave() {
+
+	epochs_slot_t* slot = epochs_self;
+	if (!slot || !slot->nest || -- slot->nest)
+		return;
+
+	__atomic_store_n(&slot->epoch, 0, __ATOMIC_RELEASE);
+}
+
+void epochs_synchronize() {
+
+	uint64_t epoch = __atomic_add_fetch(&epochs_global, 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	// own section is skipped, a writer inside a read section must not retire what it uses
+	epochs_slot_t* slot;
+	for (slot = __atomic_load_n(&epochs_slots, __ATOMIC_ACQUIRE); slot; slot = slot->next) {
+		if (slot == epochs_self)
+			continue;
+
+		int spins = 0;
+		uint64_t seen;
+		while ((seen = __atomic_load_n(&slot->epoch, __ATOMIC_ACQUIRE)) && seen < epoch) {
+			if (++ spins < EPOCHS_SPINS)
+				sched_yield();
+			else	usleep(100);
+		}
+	}
+}
+
+void epochs_retire(void* data, void (*destroy)(void*)) {
+
+	if (!data)
+		return;
+
+	epochs_retired_t* retired = malloc(sizeof(*retired));
+	if (!retired) {
+		epochs_synchronize();
+		destroy(data);
+		return;
+	}
+
+	// readers that entered before the bump may still hold data
+	retired->data = data;
+	retired->destroy = destroy;
+	retired->epoch = __atomic_add_fetch(&epochs_global, 1, __ATOMIC_SEQ_CST);
+
+	pthread_mutex_lock(&epochs_mutex);
+	retired->next = epochs_retired;
+	__atomic_store_n(&epochs_retired, retired, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&epochs_mutex);
+
+	epochs_reclaim();
+}
+
+void epochs_reclaim() {
+
+	if (!__atomic_load_n(&epochs_retired, __ATOMIC_ACQUIRE))
+		return;
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	// oldest epoch still read, zero when no section is open
+	uint64_t oldest = 0;
+	epochs_slot_t* slot;
+	for (slot = __atomic_load_n(&epochs_slots, __ATOMIC_ACQUIRE); slot; slot = slot->next) {
+		uint64_t seen = __atomic_load_n(&slot->epoch, __ATOMIC_ACQUIRE);
+		if (seen && (!oldest || seen < oldest))
+			oldest = seen;
+	}
+
+	epochs_retired_t* ready = NULL;
+
+	pthread_mutex_lock(&epochs_mutex);
+	epochs_retired_t** prev = &epochs_retired;
+	while (*prev) {
+		epochs_retired_t* retired = *prev;
+		if (oldest && oldest < retired->epoch) {
+			prev = &retired->next;
+			continue;
+		}
+
+		*prev = retired->next;
+		retired->next = ready;
+		ready = retired;
+	}
+	pthread_mutex_unlock(&epochs_mutex);
+
+	while (ready) {
+		epochs_retired_t* retired = ready;
+		ready = retired->next;
+		retired->destroy(retired->data);
+		free(retired);
+	}
+}
+
+uint64_t epochs_current() {
+
+	return __atomic_load_n(&epochs_global, __ATOMIC_ACQUIRE);
+}
+
+void* epochs_load(void* *ptr) {
+
+	return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+void epochs_publish(void* *ptr, void* value) {
+
+	__atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+}
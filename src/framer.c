@@ -0,0 +1,202 @@
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "config.h"
+#include "framer.h"
+
+#define FRAMER_BUFFER_SIZE 16384
+
+struct framer_s {
+
+	int sock;
+
+	char* buffer;
+	uint32_t size;
+	uint32_t head;
+	uint32_t tail;
+
+	uint32_t need;
+	uint32_t frame;
+};
+
+framer_t* framer_create(int sock) {
+
+	framer_t* framer = calloc(1, sizeof(*framer));
+	if (framer) {
+		framer->sock = sock;
+		framer->size = FRAMER_BUFFER_SIZE;
+		if (!(framer->buffer = malloc(framer->size))) {
+			free(framer);
+			return NULL;
+		}
+	}
+
+	return framer;
+}
+
+void framer_destroy(void* data) {
+
+	if (data) {
+		framer_t* framer = data;
+		free(framer->buffer);
+		free(data);
+	}
+}
+
+int framer_fill(framer_t* framer) {
+
+	// move unparsed bytes to the front, frame bodies stay contiguous for the parser
+	if (framer->head) {
+		memmove(framer->buffer, &framer->buffer[framer->head], framer->tail - framer->head);
+		framer->tail -= framer->head;
+		framer->head = 0;
+	}
+
+	if (framer->need > framer->size) {
+		char* buffer = realloc(framer->buffer, framer->need);
+		if (!buffer)
+			return -1;
+
+		framer->buffer = buffer;
+		framer->size = framer->need;
+	}
+
+	int msgsize = read(framer->sock, &framer->buffer[framer->tail], framer->size - framer->tail);
+	if (msgsize > 0)
+		framer->tail += msgsize;
+
+	return msgsize;
+}
+
+int framer_feed(framer_t* framer, const char* data, uint32_t size) {
+
+	if (framer->head) {
+		memmove(framer->buffer, &framer->buffer[framer->head], framer->tail - framer->head);
+		framer->tail -= framer->head;
+		framer->head = 0;
+	}
+
+	if (framer->tail + size > IO_MESSAGE_SIZE)
+		return -1;
+
+	if (framer->tail + size > framer->size) {
+		uint32_t len = framer->size;
+		while (len < framer->tail + size)
+			len *= 2;
+
+		char* buffer = realloc(framer->buffer, len);
+		if (!buffer)
+			return -1;
+
+		framer->buffer = buffer;
+		framer->size = len;
+	}
+
+	memcpy(&framer->buffer[framer->tail], data, size);
+	framer->tail += size;
+	return 0;
+}
+
+int framer_frame(framer_t* framer, uint32_t* flags, uint32_t* id, const char* *buffer, uint32_t* size) {
+
+	uint32_t len, used = framer->tail - framer->head;
+	if (used < HEADER_MSG_SIZE) {
+		framer->need = HEADER_MSG_SIZE + FRAME_ID_SIZE;
+		return 0;
+	}
+
+	memcpy(&len, &framer->buffer[framer->head], HEADER_MSG_SIZE);
+	uint32_t hsize = HEADER_MSG_SIZE + ((len & FRAME_FLAG_ID) ? FRAME_ID_SIZE : 0);
+
+	if ((len & FRAME_SIZE_MASK) > IO_BUFFER_SIZE)
+		return -1;
+
+	framer->need = hsize + (len & FRAME_SIZE_MASK);
+	if (used < framer->need)
+		return 0;
+
+	*id = 0;
+	if (len & FRAME_FLAG_ID)
+		memcpy(id, &framer->buffer[framer->head + HEADER_MSG_SIZE], FRAME_ID_SIZE);
+
+	*flags = len & ~FRAME_SIZE_MASK;
+	*size = len & FRAME_SIZE_MASK;
+	*buffer = &framer->buffer[framer->head + hsize];
+	framer->frame = framer->need;
+	return 1;
+}
+
+void framer_drop(framer_t* framer) {
+
+	framer->head += framer->frame;
+	framer->frame = 0;
+
+	if (framer->head == framer->tail)
+		framer->head = framer->tail = 0;
+}
+
+int framer_ready(framer_t* framer) {
+
+	uint32_t len, used = framer->tail - framer->head;
+	if (used < HEADER_MSG_SIZE)
+		return 0;
+
+	memcpy(&len, &framer->buffer[framer->head], HEADER_MSG_SIZE);
+	uint32_t hsize = HEADER_MSG_SIZE + ((len & FRAME_FLAG_ID) ? FRAME_ID_SIZE : 0);
+	return used >= hsize + (len & FRAME_SIZE_MASK);
+}
+
+int framer_read(framer_t* framer, uint32_t* flags, uint32_t* id, const char* *buffer, uint32_t* size) {
+
+	framer_drop(framer);
+
+	int res;
+	while (!(res = framer_frame(framer, flags, id, buffer, size))) {
+		int msgsize = framer_fill(framer);
+		if (msgsize < 0 && errno == EINTR)
+			continue;
+
+		if (msgsize <= 0)
+			return -1;
+	}
+
+	return res > 0 ? 0 : -1;
+}
+
+int framer_write(framer_t* framer, uint32_t flags, uint32_t id, const char* buffer, uint32_t size) {
+
+	uint32_t header[2] = { size | flags, id };
+	struct iovec iov[2] = {
+		{ .iov_base = header, .iov_len = HEADER_MSG_SIZE + ((flags & FRAME_FLAG_ID) ? FRAME_ID_SIZE : 0) },
+		{ .iov_base = (char*)buffer, .iov_len = size },
+	};
+
+	// one syscall for header and body, short writes continue where they stopped
+	struct iovec* it = iov;
+	int count = 2;
+	while (count) {
+		ssize_t msgsize = writev(framer->sock, it, count);
+		if (msgsize < 0) {
+			if (errno == EINTR)
+				continue;
+
+			return -1;
+		}
+
+		while (count && (size_t) msgsize >= it->iov_len) {
+			msgsize -= it->iov_len;
+			it ++;
+			count --;
+		}
+
+		if (count) {
+			it->iov_base = (char*)it->iov_base + msgsize;
+			it->iov_len -= msgsize;
+		}
+	}
+
+	return 0;
+}
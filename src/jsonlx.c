@@ -890,7 +890,7 @@ case 11:
 YY_RULE_SETUP
 #line 56 "jsonlx.l"
 {
-	yylval->i = strtod(yytext, NULL);
+	yylval->i = strtoll(yytext, NULL, 10);
 	return TOKEN_INTEGER;
 }
 	YY_BREAK
@@ -2065,9 +2065,49 @@ void yyfree (void * ptr , yyscan_t yyscanner)
 
 #line 78 "jsonlx.l"
 
-
 void yyerror(yyscan_t scanner, json_node_t* *node, char const* msg) {}
 
+// arena of the calling thread, json nodes are allocated from heap when not set
+static __thread arenas_t* json_arena;
+
+arenas_t* json_node_arena(arenas_t* arena) {
+
+	arenas_t* prev = json_arena;
+	json_arena = arena;
+	return prev;
+}
+
+void* json_alloc(size_t size) {
+
+	if (json_arena)
+		return arenas_alloc(json_arena, size);
+	else	return calloc(1, size);
+}
+
+void json_free(void* data) {
+
+	if (!json_arena)
+		free(data);
+}
+
+char* json_strdup(const char* str) {
+
+	if (json_arena)
+		return arenas_strdup(json_arena, str);
+	else	return strdup(str);
+}
+
+static json_node_t* json_node_create(json_node_type_t type) {
+
+	json_node_t* node = json_alloc(sizeof(*node));
+	if (node) {
+		node->type = type;
+		node->arena = json_arena;
+	}
+
+	return node;
+}
+
 parser_t* parser_create() {
 
 	parser_t* parser = calloc(1, sizeof(parser));
@@ -2111,19 +2151,34 @@ json_node_t* parser_parse_file(parser_t* parser, const char* file) {
 	return node;
 }
 
+int parser_write_file(json_node_t* node, json_style_t style, const char* file) {
+
+	if (!node || !file)
+		return -1;
+
+	ERROR("write file not ready yet");
+	return -1;
+}
+
 json_node_t* parser_parse_buffer(parser_t* parser, const char* buffer, int len) {
 
 	if (!parser || !buffer || !len)
 		return NULL;
 
 	json_node_t* node = NULL;
+
+	struct yyguts_t* yyg = (struct yyguts_t*)parser->scanner;
+	YY_BUFFER_STATE current = YY_CURRENT_BUFFER;
 	YY_BUFFER_STATE b = yy_scan_bytes(buffer, len, parser->scanner);
+
 	if (yyparse(parser->scanner, &node)) {
 		json_node_destroy(node);
 		node = NULL;
 	}
 
 	yy_delete_buffer(b, parser->scanner);
+	yy_switch_to_buffer(current, parser->scanner);
+
 	return node;
 }
 
@@ -2133,24 +2188,30 @@ json_node_t* parser_parse_string(parser_t* parser, const char* str) {
 		return NULL;
 
 	json_node_t* node = NULL;
+
+	struct yyguts_t* yyg = (struct yyguts_t*)parser->scanner;
+	YY_BUFFER_STATE current = YY_CURRENT_BUFFER;
 	YY_BUFFER_STATE buffer = yy_scan_string(str, parser->scanner);
+
 	if (yyparse(parser->scanner, &node)) {
 		json_node_destroy(node);
 		node = NULL;
 	}
 
 	yy_delete_buffer(buffer, parser->scanner);
-	
+	yy_switch_to_buffer(current, parser->scanner);
+
 	return node;
 }
 
 json_node_t* json_node_object(rbtree_t* tree) {
 
-	json_node_t* node = calloc(1, sizeof(*node));
+	json_node_t* node = json_node_create(JSON_NODE_TYPE_OBJECT);
 	if (node) {
-		node->type = JSON_NODE_TYPE_OBJECT;
 		if (tree)
 			node->v_object = tree;
+		else if (node->arena)
+			node->v_object = rbtree_arena(node->arena, NULL, NULL);
 		else	node->v_object = rbtree_create(free, json_node_destroy);
 	}
 
@@ -2159,12 +2220,13 @@ json_node_t* json_node_object(rbtree_t* tree) {
 
 json_node_t* json_node_array(vector_t* vector) {
 
-	json_node_t* node = calloc(1, sizeof(*node));
+	json_node_t* node = json_node_create(JSON_NODE_TYPE_ARRAY);
 	if (node) {
-		node->type = JSON_NODE_TYPE_ARRAY;
 		if (vector)
 			node->v_array = vector;
-		else	node->v_array = vector_create(0, json_node_destroy);
+		else if (node->arena)
+			node->v_array = vector_arena(node->arena, 5, NULL);
+		else	node->v_array = vector_create(5, json_node_destroy);
 	}
 
 	return node;
@@ -2175,53 +2237,50 @@ json_node_t* json_node_string(const char* value) {
 	if (!value)
 		return NULL;
 
-	json_node_t* node = calloc(1, sizeof(*node));
-	if (node) {
-		node->type = JSON_NODE_TYPE_STRING;
-		node->v_string = strdup(value);
-	}
+	json_node_t* node = json_node_create(JSON_NODE_TYPE_STRING);
+	if (node)
+		node->v_string = json_strdup(value);
 
 	return node;
 }
 
 json_node_t* json_node_int(int value) {
 
-	json_node_t* node = calloc(1, sizeof(*node));
-	if (node) {
-		node->type = JSON_NODE_TYPE_INTEGER;
+	json_node_t* node = json_node_create(JSON_NODE_TYPE_INTEGER);
+	if (node)
 		node->v_int = value;
-	}
 
 	return node;
 }
 
-json_node_t* json_node_null() {
+json_node_t* json_node_long(long long value) {
 
-	json_node_t* node = calloc(1, sizeof(*node));
+	json_node_t* node = json_node_create(JSON_NODE_TYPE_INTEGER);
 	if (node)
-		node->type = JSON_NODE_TYPE_NULL;
+		node->v_int = value;
 
 	return node;
 }
 
+json_node_t* json_node_null() {
+
+	return json_node_create(JSON_NODE_TYPE_NULL);
+}
+
 json_node_t* json_node_double(double value) {
 
-	json_node_t* node = calloc(1, sizeof(*node));
-	if (node) {
-		node->type = JSON_NODE_TYPE_DOUBLE;
+	json_node_t* node = json_node_create(JSON_NODE_TYPE_DOUBLE);
+	if (node)
 		node->v_double = value;
-	}
 
 	return node;
 }
 
 json_node_t* json_node_bool(int value) {
 
-	json_node_t* node = calloc(1, sizeof(*node));
-	if (node) {
-		node->type = JSON_NODE_TYPE_BOOL;
+	json_node_t* node = json_node_create(JSON_NODE_TYPE_BOOL);
+	if (node)
 		node->v_bool = value;
-	}
 
 	return node;
 }
@@ -2280,7 +2339,16 @@ int json_node_object_add(json_node_t* node, const char* name, json_node_t* child
 
 	if (!node || !name || !child || json_node_type(node) != JSON_NODE_TYPE_OBJECT)
 		return -1;
-	else	return set_to_rbtree(node->v_object, strdup(name), child);
+
+	// heap child of arena tree is released with the arena
+	if (node->arena) {
+		if (!child->arena && arenas_defer(node->arena, json_node_destroy, child))
+			return -1;
+
+		return set_to_rbtree(node->v_object, arenas_strdup(node->arena, name), child);
+	}
+
+	return set_to_rbtree(node->v_object, strdup(name), child);
 }
 
 int json_node_object_del(json_node_t* node, const char* name) {
@@ -2294,7 +2362,11 @@ int json_node_array_add(json_node_t* node, json_node_t* child) {
 
 	if (!node || !child || json_node_type(node) != JSON_NODE_TYPE_ARRAY)
 		return -1;
-	else	return set_to_vector(node->v_array, node);
+
+	if (node->arena && !child->arena && arenas_defer(node->arena, json_node_destroy, child))
+		return -1;
+
+	return set_to_vector(node->v_array, child);
 }
 
 int json_node_array_del(json_node_t* node, json_node_t* child) {
@@ -2310,6 +2382,11 @@ void json_node_destroy(void* data) {
 		return;
 
 	json_node_t* node = data;
+
+	// arena nodes are released all at once by arenas_reset
+	if (node->arena)
+		return;
+
 	switch (json_node_type(data)) {
 
 		case JSON_NODE_TYPE_STRING: {
@@ -2334,99 +2411,100 @@ void json_node_destroy(void* data) {
 	free(data);
 }
 
-static size_t strlcat(char* dst, int* size, ...) {
+typedef struct json_print_s json_print_t;
 
-	if (!dst || !*size)
-		return -1;
+struct json_print_s {
+
+	char* str;
+	int* len;
+};
+
+static int json_node_puts(int (*write_f)(void*, const char*, int), void* data, ...) {
 
 	int res = 0;
 	char* src;
 	va_list va;
-	va_start(va, size);
-	while (src = va_arg(va, char*)) {
-		int dstlen = strlen(dst);
-		int srclen = strlen(src);
-
-		if (*size <= 0 || dstlen + srclen >= *size) {
-			res = -1;
-			break;
-		}
-
-		memcpy(dst + dstlen, src, srclen);
-		dst[dstlen + srclen] = '\0';
-		*size-=srclen;
-	}
+	va_start(va, data);
+	while (!res && (src = va_arg(va, char*)))
+		res = write_f(data, src, strlen(src));
 	va_end(va);
 	return res;
 }
 
-int json_node_print(json_node_t* node, json_style_t style, int* len, char* str) {
+int json_node_write(json_node_t* node, json_style_t style, int (*write_f)(void* data, const char* str, int len), void* data) {
 
-	if (!node || !str || len <= 0)
+	if (!node || !write_f)
 		return -1;
 
 	int res = 0;
 	switch(json_node_type(node)) {
 		case JSON_NODE_TYPE_BOOL: {
-			if (strlcat(str, len, node->v_bool ? "TRUE" : "FALSE", NULL)) res = -1;
+			res = json_node_puts(write_f, data, node->v_bool ? "TRUE" : "FALSE", NULL);
 			break;
 		}
 
 		case JSON_NODE_TYPE_INTEGER: {
-			char buffer[16];
-			snprintf(buffer, sizeof(buffer), "%d", node->v_int);
-			if (strlcat(str, len, buffer, NULL)) res = -1;
+			char buffer[32];
+			snprintf(buffer, sizeof(buffer), "%lld", node->v_int);
+			res = json_node_puts(write_f, data, buffer, NULL);
 			break;
 		}
 
 		case JSON_NODE_TYPE_DOUBLE: {
 			char buffer[64];
 			snprintf(buffer, sizeof(buffer), "%f", node->v_double);
-			if (strlcat(str, len, buffer, NULL)) res = -1;
+			res = json_node_puts(write_f, data, buffer, NULL);
 			break;
 		}
 
 		case JSON_NODE_TYPE_NULL: {
-			if (strlcat(str, len, "NULL", NULL)) res = -1;
+			res = json_node_puts(write_f, data, "NULL", NULL);
 			break;
 		}
 
 		case JSON_NODE_TYPE_STRING: {
-			if (strlcat(str, len, "\"", node->v_string, "\"", NULL)) res = -1;
+			res = json_node_puts(write_f, data, "\"", node->v_string, "\"", NULL);
 			break;
 		}
 
 		case JSON_NODE_TYPE_OBJECT: {
 			rbtree_iterator_t* it = rbtree_iterator_create(node->v_object);
 			const char* key;
-			void* data;
+			void* child;
 
-			if (strlcat(str, len, "{", NULL)) res = -1;
+			res = json_node_puts(write_f, data, "{", NULL);
 
 			int id = rbtree_size(node->v_object);
-			while ((rbtree_iterate(it, &key, &data)) && !res) {
-				if (strlcat(str, len, "\"", key, "\":", NULL)) res = -1;
-				if (json_node_print(data, style, len, str)) res = -1;
-				if (-- id)
-					if (strlcat(str, len, ",", NULL)) res = -1;
+			while (!res && rbtree_iterate(it, &key, &child)) {
+				res = json_node_puts(write_f, data, "\"", key, "\":", NULL);
+				if (!res)
+					res = json_node_write(child, style, write_f, data);
+				if (!res && -- id)
+					res = json_node_puts(write_f, data, ",", NULL);
 			}
-			if (strlcat(str, len, "}", NULL)) res = -1;
+
+			if (!res)
+				res = json_node_puts(write_f, data, "}", NULL);
 			rbtree_iterator_destroy(it);
 			break;
 		}
 
 		case JSON_NODE_TYPE_ARRAY: {
 			vector_iterator_t* it = vector_iterator_create(node->v_array);
-			void* data;
-			if (strlcat(str, len, "[", NULL)) res = -1;
-			int id = rbtree_size(node->v_object);
-			while ((data = vector_iterate(it)) && !res) {
-				if (json_node_print(data, style, len, str)) res = -1;
-				if (-- id)
-					if (strlcat(str, len, ",", NULL)) res = -1;
+			void* child;
+
+			res = json_node_puts(write_f, data, "[", NULL);
+
+			int id = vector_used(node->v_array);
+			while (!res && (child = vector_iterate(it))) {
+				res = json_node_write(child, style, write_f, data);
+				if (!res && -- id)
+					res = json_node_puts(write_f, data, ",", NULL);
 			}
-			if (strlcat(str, len, "]", NULL)) res = -1;
-	 			vector_iterator_destroy(it);
+
+			if (!res)
+				res = json_node_puts(write_f, data, "]", NULL);
+			vector_iterator_destroy(it);
 			break;
 		}
 
@@ -2437,6 +2515,171 @@ int json_node_print(json_node_t* node, json_style_t style, int* len, char* str)
 	return res;
 }
 
+typedef struct json_count_s json_count_t;
+typedef struct json_level_s json_level_t;
+
+struct json_count_s {
+
+	int (*write_f)(void* data, const char* str, int len);
+	void* data;
+	int written;
+};
+
+struct json_level_s {
+
+	json_node_t* node;
+	void* it;
+	int count;
+};
+
+struct json_cursor_s {
+
+	json_style_t style;
+	json_node_t* node;
+	json_level_t* level;
+	int depth;
+	int size;
+};
+
+static int json_count_f(void* data, const char* str, int len) {
+
+	json_count_t* count = data;
+	count->written += len;
+	return count->write_f(count->data, str, len);
+}
+
+json_cursor_t* json_cursor_create(json_node_t* node, json_style_t style) {
+
+	if (!node)
+		return NULL;
+
+	json_cursor_t* cursor = calloc(1, sizeof(*cursor));
+	if (!cursor)
+		return NULL;
+
+	cursor->style = style;
+	cursor->node = node;
+	return cursor;
+}
+
+// containers are opened on the cursor stack, scalars are written at once
+static int json_cursor_enter(json_cursor_t* cursor, json_node_t* node, json_count_t* count) {
+
+	int type = json_node_type(node);
+	if (type != JSON_NODE_TYPE_OBJECT && type != JSON_NODE_TYPE_ARRAY)
+		return json_node_write(node, cursor->style, json_count_f, count);
+
+	if (cursor->depth == cursor->size) {
+		int size = cursor->size ? 2 * cursor->size : 8;
+		json_level_t* level = realloc(cursor->level, size * sizeof(*level));
+		if (!level)
+			return -1;
+
+		cursor->level = level;
+		cursor->size = size;
+	}
+
+	json_level_t* level = &cursor->level[cursor->depth];
+	level->node = node;
+	level->count = 0;
+	if (type == JSON_NODE_TYPE_OBJECT)
+		level->it = rbtree_iterator_create(node->v_object);
+	else	level->it = vector_iterator_create(node->v_array);
+
+	if (!level->it)
+		return -1;
+
+	cursor->depth ++;
+	return json_node_puts(json_count_f, count, type == JSON_NODE_TYPE_OBJECT ? "{" : "[", NULL);
+}
+
+static void json_cursor_leave(json_cursor_t* cursor) {
+
+	json_level_t* level = &cursor->level[-- cursor->depth];
+	if (json_node_type(level->node) == JSON_NODE_TYPE_OBJECT)
+		rbtree_iterator_destroy(level->it);
+	else	vector_iterator_destroy(level->it);
+}
+
+int json_cursor_write(json_cursor_t* cursor, int budget, int (*write_f)(void* data, const char* str, int len), void* data) {
+
+	if (!cursor || !write_f)
+		return -1;
+
+	json_count_t count = { write_f, data, 0 };
+	int res = 0;
+
+	if (cursor->node) {
+		res = json_cursor_enter(cursor, cursor->node, &count);
+		cursor->node = NULL;
+	}
+
+	// budget is checked between values, a long string goes whole
+	while (!res && cursor->depth && count.written < budget) {
+		json_level_t* level = &cursor->level[cursor->depth - 1];
+		int object = json_node_type(level->node) == JSON_NODE_TYPE_OBJECT;
+		const char* key = NULL;
+		void* child = NULL;
+
+		if (object)
+			rbtree_iterate(level->it, &key, &child);
+		else	child = vector_iterate(level->it);
+
+		if (!child) {
+			json_cursor_leave(cursor);
+			res = json_node_puts(json_count_f, &count, object ? "}" : "]", NULL);
+			continue;
+		}
+
+		if (level->count ++)
+			res = json_node_puts(json_count_f, &count, ",", NULL);
+		if (!res && object)
+			res = json_node_puts(json_count_f, &count, "\"", key, "\":", NULL);
+		if (!res)
+			res = json_cursor_enter(cursor, child, &count);
+	}
+
+	if (res)
+		return -1;
+
+	return cursor->depth ? 1 : 0;
+}
+
+void json_cursor_destroy(void* data) {
+
+	json_cursor_t* cursor = data;
+	if (!cursor)
+		return;
+
+	while (cursor->depth)
+		json_cursor_leave(cursor);
+
+	free(cursor->level);
+	free(cursor);
+}
+
+static int json_node_print_f(void* data, const char* str, int len) {
+
+	json_print_t* print = data;
+	if (*print->len <= len)
+		return -1;
+
+	memcpy(print->str, str, len);
+	print->str += len;
+	*print->str = '\0';
+	*print->len -= len;
+	return 0;
+}
+
+int json_node_print(json_node_t* node, json_style_t style, int* len, char* str) {
+
+	if (!node || !str || !len || *len <= 0)
+		return -1;
+
+	json_print_t print = { .str = str + strlen(str), .len = len };
+	return json_node_write(node, style, json_node_print_f, &print);
+}
+
 json_node_t* json_node_object_node(json_node_t* node, const char* name, json_node_type_t type) {
 
 	if (node && name && json_node_type(node) == JSON_NODE_TYPE_OBJECT) {
@@ -2449,17 +2692,29 @@ json_node_t* json_node_object_node(json_node_t* node, const char* name, json_nod
 			else	return NULL;
 		}
 	}
+
 	else
 		return NULL;
 }
 
 json_node_t* json_node_array_node(json_node_t* node, int id) {
 
-	if (!node || id > json_node_array_count(node))
+	if (!node || id >= json_node_array_count(node))
 		return NULL;
 
-	ERROR("get from array not ready !!!");
-	return NULL;
+	vector_iterator_t* it = vector_iterator_create(node->v_array);
+	json_node_t* data;
+	while ((data = vector_iterate(it)) && (id))
+		id --;
+	vector_iterator_destroy(it);
+	return data;
+}
+
+vector_t* json_node_array_vector(json_node_t* node) {
+
+	if (node && node->type == JSON_NODE_TYPE_ARRAY)
+		return node->v_array;
+	else	return NULL;
 }
 
 const char* json_node_string_value(json_node_t* node) {
@@ -2489,4 +2744,3 @@ int json_node_bool_value(json_node_t* node) {
 		return node->v_bool;
 	else	return 0;
 }
-
@@ -122,8 +122,9 @@ struct parser_s {
 struct json_node_s {
 
 	json_node_type_t type;
+	arenas_t* arena;
 	union {
-		int       v_int;
+		long long v_int;
 		double    v_double;
 		char*     v_string;
 		int       v_bool;
@@ -146,7 +147,12 @@ extern void yyerror(yyscan_t scanner, json_node_t* *node, char const* msg);
 static json_value_t* json_value_create(json_node_t* node);
 static void json_value_destroy(json_value_t* value, int mode);
 
-#line 150 "jsonpr.c" /* yacc.c:355  */
+// parser allocations follow the calling thread arena set by json_node_arena
+void* json_alloc(size_t size);
+void json_free(void* data);
+char* json_strdup(const char* str);
+
+#line 156 "jsonpr.c" /* yacc.c:355  */
 
 /* Token type.  */
 #ifndef YYTOKENTYPE
@@ -172,16 +178,16 @@ static void json_value_destroy(json_value_t* value, int mode);
 
 union YYSTYPE
 {
-#line 63 "jsonpr.y" /* yacc.c:355  */
+#line 69 "jsonpr.y" /* yacc.c:355  */
 
 	json_node_t* node;
 	char* s;
 	double d;
-	int i;
+	long long i;
 	int b;
 	json_value_t* v;
 
-#line 185 "jsonpr.c" /* yacc.c:355  */
+#line 191 "jsonpr.c" /* yacc.c:355  */
 };
 
 typedef union YYSTYPE YYSTYPE;
@@ -197,7 +203,7 @@ int yyparse (yyscan_t scanner, json_node_t* *node);
 
 /* Copy the second part of user declarations.  */
 
-#line 201 "jsonpr.c" /* yacc.c:358  */
+#line 207 "jsonpr.c" /* yacc.c:358  */
 
 #ifdef short
 # undef short
@@ -1028,39 +1034,39 @@ yydestruct (const char *yymsg, int yytype, YYSTYPE *yyvaluep, yyscan_t scanner,
   switch (yytype)
     {
           case 15: /* START  */
-#line 86 "jsonpr.y" /* yacc.c:1257  */
+#line 92 "jsonpr.y" /* yacc.c:1257  */
       { json_node_destroy (((*yyvaluep).node)); }
-#line 1034 "jsonpr.c" /* yacc.c:1257  */
+#line 1040 "jsonpr.c" /* yacc.c:1257  */
         break;
 
     case 16: /* OBJECT  */
-#line 86 "jsonpr.y" /* yacc.c:1257  */
+#line 92 "jsonpr.y" /* yacc.c:1257  */
       { json_node_destroy (((*yyvaluep).node)); }
-#line 1040 "jsonpr.c" /* yacc.c:1257  */
+#line 1046 "jsonpr.c" /* yacc.c:1257  */
         break;
 
     case 17: /* ARRAY  */
-#line 86 "jsonpr.y" /* yacc.c:1257  */
+#line 92 "jsonpr.y" /* yacc.c:1257  */
       { json_node_destroy (((*yyvaluep).node)); }
-#line 1046 "jsonpr.c" /* yacc.c:1257  */
+#line 1052 "jsonpr.c" /* yacc.c:1257  */
         break;
 
     case 18: /* MEMBER  */
-#line 85 "jsonpr.y" /* yacc.c:1257  */
+#line 91 "jsonpr.y" /* yacc.c:1257  */
       { json_value_destroy(((*yyvaluep).v), 1); }
-#line 1052 "jsonpr.c" /* yacc.c:1257  */
+#line 1058 "jsonpr.c" /* yacc.c:1257  */
         break;
 
     case 19: /* ELEMENT  */
-#line 85 "jsonpr.y" /* yacc.c:1257  */
+#line 91 "jsonpr.y" /* yacc.c:1257  */
       { json_value_destroy(((*yyvaluep).v), 1); }
-#line 1058 "jsonpr.c" /* yacc.c:1257  */
+#line 1064 "jsonpr.c" /* yacc.c:1257  */
         break;
 
     case 20: /* VALUE  */
-#line 85 "jsonpr.y" /* yacc.c:1257  */
+#line 91 "jsonpr.y" /* yacc.c:1257  */
       { json_value_destroy(((*yyvaluep).v), 1); }
-#line 1064 "jsonpr.c" /* yacc.c:1257  */
+#line 1070 "jsonpr.c" /* yacc.c:1257  */
         break;
 
 
@@ -1326,26 +1332,26 @@ yyreduce:
   switch (yyn)
     {
         case 2:
-#line 92 "jsonpr.y" /* yacc.c:1646  */
+#line 98 "jsonpr.y" /* yacc.c:1646  */
     { if (node)
 								*node = (yyvsp[0].v)->node;
 							else	json_node_destroy((yyvsp[0].v)->node);
 							json_value_destroy((yyvsp[0].v), 0);
 							(yyval.node) = NULL;
 						}
-#line 1337 "jsonpr.c" /* yacc.c:1646  */
+#line 1343 "jsonpr.c" /* yacc.c:1646  */
     break;
 
   case 3:
-#line 100 "jsonpr.y" /* yacc.c:1646  */
+#line 106 "jsonpr.y" /* yacc.c:1646  */
     { (yyval.node) = json_node_object(NULL); }
-#line 1343 "jsonpr.c" /* yacc.c:1646  */
+#line 1349 "jsonpr.c" /* yacc.c:1646  */
     break;
 
   case 4:
-#line 101 "jsonpr.y" /* yacc.c:1646  */
-    { rbtree_t* rbtree = rbtree_create(free, json_node_destroy);
-								(yyval.node) = json_node_object(rbtree);
+#line 107 "jsonpr.y" /* yacc.c:1646  */
+    { (yyval.node) = json_node_object(NULL);
+								rbtree_t* rbtree = (yyval.node)->v_object;
 								json_value_t* value = (yyvsp[-1].v);
 
 								while (value) {
@@ -1355,99 +1361,108 @@ yyreduce:
 
 								json_value_destroy((yyvsp[-1].v), 0);
 						}
-#line 1359 "jsonpr.c" /* yacc.c:1646  */
+#line 1365 "jsonpr.c" /* yacc.c:1646  */
     break;
 
   case 5:
-#line 114 "jsonpr.y" /* yacc.c:1646  */
+#line 123 "jsonpr.y" /* yacc.c:1646  */
     { (yyval.node) = json_node_array(NULL); }
-#line 1365 "jsonpr.c" /* yacc.c:1646  */
+#line 1371 "jsonpr.c" /* yacc.c:1646  */
     break;
 
   case 6:
-#line 115 "jsonpr.y" /* yacc.c:1646  */
-    { vector_t* vector = vector_create(0, json_node_destroy);
-								(yyval.node) = json_node_array(vector);
-								json_value_t* value = (yyvsp[-1].v);
+#line 124 "jsonpr.y" /* yacc.c:1646  */
+    { (yyval.node) = json_node_array(NULL);
+								vector_t* vector = (yyval.node)->v_array;
+								json_value_t* value = (yyvsp[-1].v), *prev = NULL, *next;
+								int count = 0;
 
+								// elements are linked last first, reverse them to keep array order
 								while (value) {
-									set_to_vector(vector, value->node);
-									value = value->next;
+									next = value->next;
+									value->next = prev;
+									prev = value;
+									value = next;
+									count ++;
 								}
 
-								json_value_destroy((yyvsp[-1].v), 0);
+								vector_resize(vector, count);
+								for (value = prev; value; value = value->next)
+									set_to_vector(vector, value->node);
+
+								json_value_destroy(prev, 0);
 						}
-#line 1381 "jsonpr.c" /* yacc.c:1646  */
+#line 1396 "jsonpr.c" /* yacc.c:1646  */
     break;
 
   case 7:
-#line 128 "jsonpr.y" /* yacc.c:1646  */
-    { (yyval.v) = (yyvsp[0].v);                (yyvsp[0].v)->name = strdup((yyvsp[-2].s)); }
-#line 1387 "jsonpr.c" /* yacc.c:1646  */
+#line 143 "jsonpr.y" /* yacc.c:1646  */
+    { (yyval.v) = (yyvsp[0].v);                (yyvsp[0].v)->name = json_strdup((yyvsp[-2].s)); }
+#line 1402 "jsonpr.c" /* yacc.c:1646  */
     break;
 
   case 8:
-#line 129 "jsonpr.y" /* yacc.c:1646  */
-    { (yyval.v) = (yyvsp[0].v); (yyvsp[0].v)->next = (yyvsp[-4].v); (yyvsp[0].v)->name = strdup((yyvsp[-2].s)); }
-#line 1393 "jsonpr.c" /* yacc.c:1646  */
+#line 144 "jsonpr.y" /* yacc.c:1646  */
+    { (yyval.v) = (yyvsp[0].v); (yyvsp[0].v)->next = (yyvsp[-4].v); (yyvsp[0].v)->name = json_strdup((yyvsp[-2].s)); }
+#line 1408 "jsonpr.c" /* yacc.c:1646  */
     break;
 
   case 9:
-#line 132 "jsonpr.y" /* yacc.c:1646  */
+#line 147 "jsonpr.y" /* yacc.c:1646  */
     { (yyval.v) = (yyvsp[0].v);                }
-#line 1399 "jsonpr.c" /* yacc.c:1646  */
+#line 1414 "jsonpr.c" /* yacc.c:1646  */
     break;
 
   case 10:
-#line 133 "jsonpr.y" /* yacc.c:1646  */
+#line 148 "jsonpr.y" /* yacc.c:1646  */
     { (yyval.v) = (yyvsp[0].v); (yyvsp[0].v)->next = (yyvsp[-2].v); }
-#line 1405 "jsonpr.c" /* yacc.c:1646  */
+#line 1420 "jsonpr.c" /* yacc.c:1646  */
     break;
 
   case 11:
-#line 136 "jsonpr.y" /* yacc.c:1646  */
+#line 151 "jsonpr.y" /* yacc.c:1646  */
     { (yyval.v) = json_value_create((yyvsp[0].node)); }
-#line 1411 "jsonpr.c" /* yacc.c:1646  */
+#line 1426 "jsonpr.c" /* yacc.c:1646  */
     break;
 
   case 12:
-#line 137 "jsonpr.y" /* yacc.c:1646  */
+#line 152 "jsonpr.y" /* yacc.c:1646  */
     { (yyval.v) = json_value_create((yyvsp[0].node)); }
-#line 1417 "jsonpr.c" /* yacc.c:1646  */
+#line 1432 "jsonpr.c" /* yacc.c:1646  */
     break;
 
   case 13:
-#line 138 "jsonpr.y" /* yacc.c:1646  */
+#line 153 "jsonpr.y" /* yacc.c:1646  */
     { (yyval.v) = json_value_create(json_node_string((yyvsp[0].s))); }
-#line 1423 "jsonpr.c" /* yacc.c:1646  */
+#line 1438 "jsonpr.c" /* yacc.c:1646  */
     break;
 
   case 14:
-#line 139 "jsonpr.y" /* yacc.c:1646  */
+#line 154 "jsonpr.y" /* yacc.c:1646  */
     { (yyval.v) = json_value_create(json_node_bool  ((yyvsp[0].b))); }
-#line 1429 "jsonpr.c" /* yacc.c:1646  */
+#line 1444 "jsonpr.c" /* yacc.c:1646  */
     break;
 
   case 15:
-#line 140 "jsonpr.y" /* yacc.c:1646  */
-    { (yyval.v) = json_value_create(json_node_int   ((yyvsp[0].i))); }
-#line 1435 "jsonpr.c" /* yacc.c:1646  */
+#line 155 "jsonpr.y" /* yacc.c:1646  */
+    { (yyval.v) = json_value_create(json_node_long  ((yyvsp[0].i))); }
+#line 1450 "jsonpr.c" /* yacc.c:1646  */
     break;
 
   case 16:
-#line 141 "jsonpr.y" /* yacc.c:1646  */
+#line 156 "jsonpr.y" /* yacc.c:1646  */
     { (yyval.v) = json_value_create(json_node_double((yyvsp[0].d))); }
-#line 1441 "jsonpr.c" /* yacc.c:1646  */
+#line 1456 "jsonpr.c" /* yacc.c:1646  */
     break;
 
   case 17:
-#line 142 "jsonpr.y" /* yacc.c:1646  */
+#line 157 "jsonpr.y" /* yacc.c:1646  */
     { (yyval.v) = json_value_create(json_node_null  (  )); }
-#line 1447 "jsonpr.c" /* yacc.c:1646  */
+#line 1462 "jsonpr.c" /* yacc.c:1646  */
     break;
 
 
-#line 1451 "jsonpr.c" /* yacc.c:1646  */
+#line 1466 "jsonpr.c" /* yacc.c:1646  */
       default: break;
     }
   /* User semantic actions sometimes alter yychar, and that requires
@@ -1675,13 +1690,13 @@ yyreturn:
 #endif
   return yyresult;
 }
-#line 145 "jsonpr.y" /* yacc.c:1906  */
+#line 160 "jsonpr.y" /* yacc.c:1906  */
 
 
 static json_value_t* json_value_create(json_node_t* node) {
 
 	json_value_t* value;
-	if (value = calloc(1, sizeof(json_value_t)))
+	if (value = json_alloc(sizeof(json_value_t)))
 		value->node = node;
 
 	return value;
@@ -1694,7 +1709,7 @@ static void json_value_destroy(json_value_t* value, int mode) {
 
 	if (mode) { // destroy data or not
 		if (value->name)
-			free(value->name);
+			json_free(value->name);
 
 		if (value->node)
 			json_node_destroy(value->node);
@@ -1703,5 +1718,5 @@ static void json_value_destroy(json_value_t* value, int mode) {
 	if (value->next)
 		json_value_destroy(value->next, mode);
 
-	free(value);
+	json_free(value);
 }
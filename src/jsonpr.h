@@ -69,8 +69,9 @@ struct parser_s {
 struct json_node_s {
 
 	json_node_type_t type;
+	arenas_t* arena;
 	union {
-		int       v_int;
+		long long v_int;
 		double    v_double;
 		char*     v_string;
 		int       v_bool;
@@ -93,7 +94,12 @@ extern void yyerror(yyscan_t scanner, json_node_t* *node, char const* msg);
 static json_value_t* json_value_create(json_node_t* node);
 static void json_value_destroy(json_value_t* value, int mode);
 
-#line 97 "jsonpr.h" /* yacc.c:1909  */
+// parser allocations follow the calling thread arena set by json_node_arena
+void* json_alloc(size_t size);
+void json_free(void* data);
+char* json_strdup(const char* str);
+
+#line 103 "jsonpr.h" /* yacc.c:1909  */
 
 /* Token type.  */
 #ifndef YYTOKENTYPE
@@ -119,16 +125,16 @@ static void json_value_destroy(json_value_t* value, int mode);
 
 union YYSTYPE
 {
-#line 63 "jsonpr.y" /* yacc.c:1909  */
+#line 69 "jsonpr.y" /* yacc.c:1909  */
 
 	json_node_t* node;
 	char* s;
 	double d;
-	int i;
+	long long i;
 	int b;
 	json_value_t* v;
 
-#line 132 "jsonpr.h" /* yacc.c:1909  */
+#line 138 "jsonpr.h" /* yacc.c:1909  */
 };
 
 typedef union YYSTYPE YYSTYPE;
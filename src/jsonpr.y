@@ -30,8 +30,9 @@ struct parser_s {
 struct json_node_s {
 
 	json_node_type_t type;
+	arenas_t* arena;
 	union {
-		int       v_int;
+		long long v_int;
 		double    v_double;
 		char*     v_string;
 		int       v_bool;
@@ -53,13 +54,18 @@ int yylex();
 extern void yyerror(yyscan_t scanner, json_node_t* *node, char const* msg);
 static json_value_t* json_value_create(json_node_t* node);
 static void json_value_destroy(json_value_t* value, int mode);
+
+// parser allocations follow the calling thread arena set by json_node_arena
+void* json_alloc(size_t size);
+void json_free(void* data);
+char* json_strdup(const char* str);
 }
 
 %union {
 	json_node_t* node;
 	char* s;
 	double d;
-	int i;
+	long long i;
 	int b;
 	json_value_t* v;
 }
@@ -93,8 +99,8 @@ START	:	VALUE					{ if (node)
 ;
 
 OBJECT	:	'{' '}'					{ $$ = json_node_object(NULL); }
-	|	'{' MEMBER '}'				{ rbtree_t* rbtree = rbtree_create(free, json_node_destroy);
-								$$ = json_node_object(rbtree);
+	|	'{' MEMBER '}'				{ $$ = json_node_object(NULL);
+								rbtree_t* rbtree = $$->v_object;
 								json_value_t* value = $2;
 
 								while (value) {
@@ -107,21 +113,30 @@ OBJECT	:	'{' '}'					{ $$ = json_node_object(NULL); }
 ;
 
 ARRAY	:	'[' ']'					{ $$ = json_node_array(NULL); }
-	|	'[' ELEMENT ']'				{ vector_t* vector = vector_create(0, json_node_destroy);
-								$$ = json_node_array(vector);
-								json_value_t* value = $2;
+	|	'[' ELEMENT ']'				{ $$ = json_node_array(NULL);
+								vector_t* vector = $$->v_array;
+								json_value_t* value = $2, *prev = NULL, *next;
+								int count = 0;
 
+								// elements are linked last first, reverse them to keep array order
 								while (value) {
-									set_to_vector(vector, value->node);
-									value = value->next;
+									next = value->next;
+									value->next = prev;
+									prev = value;
+									value = next;
+									count ++;
 								}
 
-								json_value_destroy($2, 0);
+								vector_resize(vector, count);
+								for (value = prev; value; value = value->next)
+									set_to_vector(vector, value->node);
+
+								json_value_destroy(prev, 0);
 						}
 ;
 
-MEMBER	:	TOKEN_STRING ':' VALUE			{ $$ = $3;                $3->name = strdup($1); }
-	|	MEMBER ',' TOKEN_STRING ':' VALUE	{ $$ = $5; $5->next = $1; $5->name = strdup($3); }
+MEMBER	:	TOKEN_STRING ':' VALUE			{ $$ = $3;                $3->name = json_strdup($1); }
+	|	MEMBER ',' TOKEN_STRING ':' VALUE	{ $$ = $5; $5->next = $1; $5->name = json_strdup($3); }
 ;
 
 ELEMENT	:	VALUE					{ $$ = $1;                }
@@ -132,7 +147,7 @@ VALUE	:	OBJECT					{ $$ = json_value_create($1); }
 	|	ARRAY					{ $$ = json_value_create($1); }
 	|	TOKEN_STRING				{ $$ = json_value_create(json_node_string($1)); }
 	|	TOKEN_BOOL				{ $$ = json_value_create(json_node_bool  ($1)); }
-	|	TOKEN_INTEGER				{ $$ = json_value_create(json_node_int   ($1)); }
+	|	TOKEN_INTEGER				{ $$ = json_value_create(json_node_long  ($1)); }
 	|	TOKEN_DOUBLE				{ $$ = json_value_create(json_node_double($1)); }
 	|	TOKEN_NULL				{ $$ = json_value_create(json_node_null  (  )); }
 ;
@@ -142,7 +157,7 @@ VALUE	:	OBJECT					{ $$ = json_value_create($1); }
 static json_value_t* json_value_create(json_node_t* node) {
 
 	json_value_t* value;
-	if (value = calloc(1, sizeof(json_value_t)))
+	if (value = json_alloc(sizeof(json_value_t)))
 		value->node = node;
 
 	return value;
@@ -155,7 +170,7 @@ static void json_value_destroy(json_value_t* value, int mode) {
 
 	if (mode) { // destroy data or not
 		if (value->name)
-			free(value->name);
+			json_free(value->name);
 
 		if (value->node)
 			json_node_destroy(value->node);
@@ -164,5 +179,5 @@ static void json_value_destroy(json_value_t* value, int mode) {
 	if (value->next)
 		json_value_destroy(value->next, mode);
 
-	free(value);
+	json_free(value);
 }
@@ -1,48 +1,135 @@
 
 #include <dlfcn.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "propes.h"
 #include "rbtree.h"
+#include "epochs.h"
 #include "logger.h"
 #include "loader.h"
 
 #define EXPORT "export"
+#define RELOAD_DIR "/tmp"
+#define RELOAD_COPY "vmixer-XXXXXX.so"
 
 struct loader_s {
 
-	const char *file;
+	char *file;
 	void *handle;
 	module_t* module;
+	// serializes writers, readers walk the published pool inside epochs sections
 	locker_t* locker;
 	rbtree_t* pool;
+	// bumped after every pool publish, cached lookups compare it
+	uint64_t generation;
+	// properties copied by loader_reload, loader_retire takes later changes of the old version
+	rbtree_t* copied;
+
+	// calls in flight, a replaced version is destroyed after they return
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int refs;
+
+	// open addressing index over module methods, built once at load
+	method_t** methods;
+	uint32_t mask;
 };
 
-loader_t* loader_create(const char* file) {
+static uint32_t loader_hash(const char* name) {
 
-	if (!file)
-		return NULL;
+	uint32_t hash = 2166136261u;
+	while (*name) {
+		hash ^= (unsigned char)*name ++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static int loader_index(loader_t* loader) {
+
+	uint32_t count = 0, size = 8;
+	if (loader->module->methods) {
+		while (loader->module->methods[count].name)
+			count ++;
+	}
+
+	// at most half full, probes stay short
+	while (size < count * 2)
+		size <<= 1;
+
+	if (!(loader->methods = calloc(size, sizeof(method_t*))))
+		return -1;
+
+	loader->mask = size - 1;
+
+	uint32_t id;
+	for (id = 0; id < count; id ++) {
+		method_t* method = &loader->module->methods[id];
+		uint32_t slot = loader_hash(method->name) & loader->mask;
+
+		// first declaration wins, as with the scan in thread_method()
+		while (loader->methods[slot] && strcmp(loader->methods[slot]->name, method->name))
+			slot = (slot + 1) & loader->mask;
+
+		if (!loader->methods[slot])
+			loader->methods[slot] = method;
+	}
+
+	return 0;
+}
+
+static loader_t* loader_open(const char* file, const char* path, const char** error) {
 
 	loader_t* loader = malloc(sizeof(*loader));
 	if (loader) {
-		loader->file = file;
-		loader->handle = dlopen(file, RTLD_NOW);
+		loader->handle = dlopen(path, RTLD_NOW);
 		if (!loader->handle) {
-			ERROR("%s", dlerror());
+			const char* reason = dlerror();
+			ERROR("can't load module file '%s' from '%s': %s", file, path, reason);
+			if (error)
+				*error = reason;
 			free(loader);
 			return NULL;
 		}
 
 		loader->module = dlsym(loader->handle, EXPORT);
 		if (!loader->module) {
-			ERROR("%s", dlerror());
+			const char* reason = dlerror();
+			ERROR("can't find '%s' in module file '%s': %s", EXPORT, file, reason);
+			if (error)
+				*error = reason;
 			dlclose(loader->handle);
 			free(loader);
 			return NULL;
 		}
 
-		loader->pool = rbtree_create(NULL, thread_destroy);
+		if (!(loader->file = strdup(file))) {
+			dlclose(loader->handle);
+			free(loader);
+			return NULL;
+		}
+
+		if (loader_index(loader)) {
+			dlclose(loader->handle);
+			free(loader->file);
+			free(loader);
+			return NULL;
+		}
+
+		loader->pool = rbtree_create(NULL, NULL);
 		loader->locker = locker_create();
+		loader->refs = 0;
+		loader->generation = 0;
+		loader->copied = NULL;
+		pthread_mutex_init(&loader->mutex, NULL);
+		pthread_cond_init(&loader->cond, NULL);
 
 		if (loader->module->on_init_f) {
 			DEBUG("module: \"%s\" on_init() started", loader->module->name, loader->module->on_init_f);
@@ -56,18 +143,266 @@ loader_t* loader_create(const char* file) {
 	return loader;
 }
 
+loader_t* loader_create(const char* file) {
+
+	if (!file)
+		return NULL;
+
+	return loader_open(file, file, NULL);
+}
+
+// dlopen() hands back the mapped object for a path it already knows,
+// a private copy in $TMPDIR makes the new version load beside the old one
+static int loader_copy(const char* file, char* path, size_t len, const char** error) {
+
+	const char* dir = getenv("TMPDIR");
+	if (!dir || !*dir)
+		dir = RELOAD_DIR;
+
+	if (snprintf(path, len, "%s/%s", dir, RELOAD_COPY) >= (int) len) {
+		ERROR("module copy directory '%s' is too long", dir);
+		*error = "module copy directory is too long";
+		return -1;
+	}
+
+	int in = open(file, O_RDONLY | O_CLOEXEC);
+	if (in < 0) {
+		ERROR("can't open module file '%s': %m", file);
+		*error = "can't open module file";
+		return -1;
+	}
+
+	int out = mkstemps(path, 3);
+	if (out < 0) {
+		ERROR("can't create module copy '%s': %m", path);
+		*error = "can't create module copy";
+		close(in);
+		return -1;
+	}
+
+	char buffer[16384];
+	ssize_t size;
+	while ((size = read(in, buffer, sizeof(buffer))) > 0) {
+		if (write(out, buffer, size) != size) {
+			size = -1;
+			break;
+		}
+	}
+
+	close(in);
+	close(out);
+
+	if (size < 0) {
+		ERROR("can't copy module file '%s': %m", file);
+		*error = "can't copy module file";
+		unlink(path);
+		return -1;
+	}
+
+	return 0;
+}
+
+loader_t* loader_reload(loader_t* loader, const char* file, const char** error) {
+
+	const char* reason = NULL;
+	if (!error)
+		error = &reason;
+
+	if (!loader)
+		return NULL;
+
+	if (!file)
+		file = loader->file;
+
+	char path[PATH_MAX];
+	if (loader_copy(file, path, sizeof(path), error))
+		return NULL;
+
+	loader_t* reload = loader_open(file, path, error);
+	unlink(path);
+
+	if (!reload)
+		return NULL;
+
+	if (strcmp(reload->module->name, loader->module->name)) {
+		ERROR("module file '%s' exports '%s' instead of '%s'", file, reload->module->name, loader->module->name);
+		*error = "module file exports another module";
+		loader_destroy(reload);
+		return NULL;
+	}
+
+	// threads are recreated by name, properties known to both versions are copied without events
+	rbtree_iterator_t* it = rbtree_iterator_create(loader->pool);
+	reload->copied = rbtree_create(free, propes_destroy);
+
+	const char* key;
+	void* data;
+
+	locker_set(loader->locker, THREAD_LOCK_READ);
+	while (rbtree_iterate(it, &key, &data)) {
+		thread_t* thread = thread_create(reload->module, thread_name(data));
+		if (!thread)
+			continue;
+
+		if (reload->module->props) {
+			propes_t* copied = propes_create(reload->module->props);
+			char* name = strdup(thread_name(thread));
+			if (!copied || !name || set_to_rbtree(reload->copied, name, copied)) {
+				propes_destroy(copied);
+				free(name);
+				copied = NULL;
+			}
+
+			locker_set(thread_locker(data), THREAD_LOCK_READ);
+			int id = 0;
+			while (reload->module->props[id].name) {
+				const char* value = get_from_propes(thread_propes(data), reload->module->props[id].name);
+				if (value) {
+					set_to_propes_quiet(thread_propes(thread), reload->module->props[id].name, value);
+					set_to_propes_quiet(copied, reload->module->props[id].name, value);
+				}
+				id ++;
+			}
+			locker_set(thread_locker(data), THREAD_UNLOCK_READ);
+		}
+
+		// reload is not published yet, its pool is filled in place
+		if (set_to_rbtree(reload->pool, thread_name(thread), thread))
+			thread_destroy(thread);
+	}
+	locker_set(loader->locker, THREAD_UNLOCK_READ);
+	rbtree_iterator_destroy(it);
+
+	return reload;
+}
+
+// properties set on the old version between the copy and the drain are copied again,
+// a value the new version changed since is kept, subscribers saw the change on the old one
+static void loader_recopy(loader_t* loader, loader_t* reload) {
+
+	rbtree_iterator_t* it = rbtree_iterator_create(reload->copied);
+
+	const char* key;
+	void* copied;
+
+	while (rbtree_iterate(it, &key, &copied)) {
+		thread_t* old = get_from_rbtree(loader->pool, key);
+		if (!old)
+			continue;
+
+		// a thread replaced by set_to_loader is destroyed after grace, it is looked up in a section
+		epochs_enter();
+		thread_t* thread = get_from_loader(reload, key);
+		int id = 0;
+		while (thread && reload->module->props[id].name) {
+			const char* name = reload->module->props[id].name;
+			const char* value = get_from_propes(thread_propes(old), name);
+			const char* was = get_from_propes(copied, name);
+			const char* now = get_from_propes(thread_propes(thread), name);
+
+			if (value && was && now && strcmp(value, was) && !strcmp(was, now))
+				set_to_propes_quiet(thread_propes(thread), name, value);
+			id ++;
+		}
+		epochs_leave();
+	}
+
+	rbtree_iterator_destroy(it);
+	rbtree_destroy(reload->copied);
+	reload->copied = NULL;
+}
+
+void loader_retire(loader_t* loader, loader_t* reload) {
+
+	if (!loader)
+		return;
+
+	// calls on the old version are counted in read sections entered before it was replaced
+	epochs_synchronize();
+
+	pthread_mutex_lock(&loader->mutex);
+	while (loader->refs)
+		pthread_cond_wait(&loader->cond, &loader->mutex);
+	pthread_mutex_unlock(&loader->mutex);
+
+	if (reload)
+		loader_recopy(loader, reload);
+
+	rbtree_t* started = rbtree_create(NULL, NULL);
+	rbtree_iterator_t* it = rbtree_iterator_create(loader->pool);
+
+	const char* key;
+	void* data;
+
+	while (rbtree_iterate(it, &key, &data)) {
+		if (started && thread_state(data) == THREAD_STATE_STARTED)
+			set_to_rbtree(started, thread_name(data), data);
+	}
+	rbtree_iterator_destroy(it);
+
+	// routines are restarted on the new version one thread at a time
+	if (reload && started) {
+		it = rbtree_iterator_create(reload->pool);
+		while (rbtree_iterate(it, &key, &data)) {
+			thread_t* thread = get_from_rbtree(started, key);
+			if (thread) {
+				thread_state_set(thread, THREAD_STATE_STOPPED);
+				thread_state_set(data, THREAD_STATE_STARTED);
+			}
+		}
+		rbtree_iterator_destroy(it);
+	}
+
+	rbtree_destroy(started);
+	loader_destroy(loader);
+}
+
 void loader_destroy(void* data) {
 
 	if (data) {
 		loader_t* loader = data;
 		INFO("module: '%s' unloaded. file: '%s'", loader->module->name, loader->file);
+
+		rbtree_iterator_t* it = rbtree_iterator_create(loader->pool);
+		void* thread;
+
+		while (rbtree_iterate(it, NULL, &thread))
+			thread_destroy(thread);
+
+		rbtree_iterator_destroy(it);
 		rbtree_destroy(loader->pool);
+		rbtree_destroy(loader->copied);
 		locker_destroy(loader->locker);
+		pthread_cond_destroy(&loader->cond);
+		pthread_mutex_destroy(&loader->mutex);
 		dlclose(loader->handle);
+		free(loader->methods);
+		free(loader->file);
 		free(data);
 	}
 }
 
+void loader_acquire(loader_t* loader) {
+
+	if (!loader)
+		return;
+
+	pthread_mutex_lock(&loader->mutex);
+	loader->refs ++;
+	pthread_mutex_unlock(&loader->mutex);
+}
+
+void loader_release(loader_t* loader) {
+
+	if (!loader)
+		return;
+
+	pthread_mutex_lock(&loader->mutex);
+	if (!-- loader->refs)
+		pthread_cond_broadcast(&loader->cond);
+	pthread_mutex_unlock(&loader->mutex);
+}
+
 module_t* loader_module(loader_t* loader) {
 
 	if (!loader)
@@ -89,10 +424,46 @@ int set_to_loader(loader_t* loader, thread_t* thread) {
 	if (!loader || !thread)
 		return -1;
 
+	// pool is copied on write, readers keep the snapshot they loaded
 	locker_set(loader->locker, THREAD_LOCK_WRITE);
-	int res = set_to_rbtree(loader->pool, thread_name(thread), thread);
+	rbtree_t* pool = loader->pool;
+	rbtree_t* copy = rbtree_clone(pool);
+	thread_t* replaced = get_from_rbtree(pool, thread_name(thread));
+
+	if (!copy || set_to_rbtree(copy, thread_name(thread), thread)) {
+		locker_set(loader->locker, THREAD_UNLOCK_WRITE);
+		rbtree_destroy(copy);
+		return -1;
+	}
+
+	epochs_publish((void**)&loader->pool, copy);
+	__atomic_add_fetch(&loader->generation, 1, __ATOMIC_SEQ_CST);
 	locker_set(loader->locker, THREAD_UNLOCK_WRITE);
-	return res;
+
+	epochs_synchronize();
+	rbtree_destroy(pool);
+	if (replaced && replaced != thread)
+		thread_destroy(replaced);
+
+	return 0;
+}
+
+method_t* loader_method(loader_t* loader, const char* name) {
+
+	if (!loader || !name)
+		return NULL;
+
+	uint32_t slot = loader_hash(name) & loader->mask;
+	method_t* method;
+
+	while ((method = loader->methods[slot])) {
+		if (!strcmp(method->name, name))
+			return method;
+
+		slot = (slot + 1) & loader->mask;
+	}
+
+	return NULL;
 }
 
 thread_t* get_from_loader(loader_t* loader, const char* name) {
@@ -100,7 +471,44 @@ thread_t* get_from_loader(loader_t* loader, const char* name) {
 	if (!loader || !name)
 		return NULL;
 
-	return get_from_rbtree(loader->pool, name);
+	return get_from_rbtree(epochs_load((void**)&loader->pool), name);
+}
+
+int loader_foreach(loader_t* loader, void (*thread_f)(void* data, thread_t* thread), void* data) {
+
+	if (!loader || !thread_f)
+		return -1;
+
+	epochs_enter();
+	rbtree_iterator_t* it = rbtree_iterator_create(epochs_load((void**)&loader->pool));
+	void* thread;
+
+	while (rbtree_iterate(it, NULL, &thread))
+		thread_f(data, thread);
+
+	rbtree_iterator_destroy(it);
+	epochs_leave();
+	return 0;
+}
+
+int loader_threads(loader_t* loader) {
+
+	if (!loader)
+		return -1;
+
+	epochs_enter();
+	int threads = rbtree_size(epochs_load((void**)&loader->pool));
+	epochs_leave();
+
+	return threads;
+}
+
+uint64_t loader_generation(loader_t* loader) {
+
+	if (!loader)
+		return 0;
+
+	return __atomic_load_n(&loader->generation, __ATOMIC_ACQUIRE);
 }
 
 locker_t* loader_locker(loader_t* loader) {
@@ -152,19 +560,20 @@ int loader_info(loader_t* loader, json_node_t* info) {
 	}
 
 	json_node_object_add(info, "pool", json_node_object(NULL));
-	rbtree_iterator_t* it = rbtree_iterator_create(loader->pool);
+
+	epochs_enter();
+	rbtree_iterator_t* it = rbtree_iterator_create(epochs_load((void**)&loader->pool));
 
 	const char* key;
 	void* data;
 
-	locker_set(loader->locker, THREAD_LOCK_READ);
 	while (rbtree_iterate(it, &key, &data)) {
 		json_node_t* thread = json_node_object(NULL);
 		thread_info(data, thread);
 		json_node_object_add(json_node_object_node(info, "pool", JSON_NODE_TYPE_OBJECT), thread_name(data), thread);
 	}
-	locker_set(loader->locker, THREAD_UNLOCK_READ);
 	rbtree_iterator_destroy(it);
+	epochs_leave();
 
 	return 0;
 }
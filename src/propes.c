@@ -16,6 +16,9 @@ struct property_entry_s {
 
 	property_t* property;
 	char value[VALUE_LEN_MAX];
+
+	void (*observe_f)(void* data, property_t* property, const char* value);
+	void* data;
 };
 
 const char* check_type_str(property_t* property, const char* value) {
@@ -118,7 +121,7 @@ const char* get_from_propes(propes_t* propes, const char* name) {
 	return entry->value;
 }
 
-int set_to_propes(propes_t* propes, const char* name, const char* value) {
+static int propes_set(propes_t* propes, const char* name, const char* value, int notify) {
 
 	if (!propes || !name || !value)
 		return -1;
@@ -130,6 +133,38 @@ int set_to_propes(propes_t* propes, const char* name, const char* value) {
 	if (entry->property->check)
 		value = entry->property->check(entry->property, value);
 
+	int changed = strncmp(entry->value, value, sizeof(entry->value));
 	strncpy(entry->value, value, sizeof(entry->value));
+
+	if (notify && changed && entry->observe_f)
+		entry->observe_f(entry->data, entry->property, entry->value);
+
+	return 0;
+}
+
+int set_to_propes(propes_t* propes, const char* name, const char* value) {
+
+	return propes_set(propes, name, value, !0);
+}
+
+int set_to_propes_quiet(propes_t* propes, const char* name, const char* value) {
+
+	return propes_set(propes, name, value, 0);
+}
+
+int propes_observe(propes_t* propes, void (*observe_f)(void* data, property_t* property, const char* value), void* data) {
+
+	if (!propes)
+		return -1;
+
+	rbtree_iterator_t* it = rbtree_iterator_create(propes);
+	property_entry_t* entry;
+
+	while (rbtree_iterate(it, NULL, (void**)&entry)) {
+		entry->observe_f = observe_f;
+		entry->data = data;
+	}
+
+	rbtree_iterator_destroy(it);
 	return 0;
 }
@@ -2,6 +2,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include "vector.h"
+#include "arenas.h"
 #include "rbtree.h"
 
 #define RED_COLOR 'r'
@@ -16,6 +17,8 @@ struct rbtree_s {
 	void (*destroy_key_f) (void* key);
 	void (*destroy_data_f) (void* data);
 	int size;
+
+	arenas_t* arena;
 };
 
 struct rbtree_entry_s {
@@ -56,7 +59,8 @@ void rbtree_recursive_destroy(rbtree_t *tree, rbtree_entry_t* entry, int mode) {
 				tree->destroy_data_f(entry->data);
 		}
 
-		free(entry);
+		if (!tree->arena)
+			free(entry);
 	}
 }
 
@@ -155,14 +159,59 @@ rbtree_t* rbtree_create(void (*destroy_key_f) (void*), void (*destroy_data_f)(vo
 	return tree;
 }
 
+rbtree_t* rbtree_clone(rbtree_t* rbtree) {
+
+	if (!rbtree)
+		return NULL;
+
+	rbtree_t* tree = rbtree_create(NULL, NULL);
+	rbtree_iterator_t* it = rbtree_iterator_create(rbtree);
+
+	const char* key;
+	void* data;
+
+	while (tree && it && rbtree_iterate(it, &key, &data)) {
+		if (set_to_rbtree(tree, (char*)key, data)) {
+			rbtree_destroy(tree);
+			tree = NULL;
+		}
+	}
+
+	if (!it) {
+		rbtree_destroy(tree);
+		tree = NULL;
+	}
+
+	rbtree_iterator_destroy(it);
+	return tree;
+}
+
+rbtree_t* rbtree_arena(arenas_t* arena, void (*destroy_key_f) (void*), void (*destroy_data_f)(void*)) {
+
+	rbtree_t* tree = arenas_alloc(arena, sizeof(*tree));
+	if (tree) {
+		tree->root = &RBTREE_NODE_INITIALIZER;
+		tree->destroy_key_f  = destroy_key_f;
+		tree->destroy_data_f = destroy_data_f;
+		tree->arena = arena;
+	}
+	return tree;
+}
+
 void rbtree_destroy(void* data) {
 
 	if (!data)
 		return;
 
 	rbtree_t* tree = data;
+
+	// arena entries go away with arena reset, nothing to walk without destroyers
+	if (tree->arena && !tree->destroy_key_f && !tree->destroy_data_f)
+		return;
+
 	rbtree_recursive_destroy(tree, tree->root, !0);
-	free(data);
+	if (!tree->arena)
+		free(data);
 }
 
 int set_to_rbtree(rbtree_t* tree, char* key, void* data) {
@@ -191,7 +240,7 @@ int set_to_rbtree(rbtree_t* tree, char* key, void* data) {
 		current = strcmp(key, current->key) < 0 ? current->left : current->right;
 	}
 
-	rbtree_entry_t *node = malloc(sizeof(*node));
+	rbtree_entry_t *node = tree->arena ? arenas_alloc(tree->arena, sizeof(*node)) : malloc(sizeof(*node));
 	if (!node)
 		return -1;
 
@@ -390,7 +439,8 @@ int delete_from_rbtree(rbtree_t* tree, const char* key) {
 		tree->destroy_data_f(y->data);
 
 	tree->size--;
-	free(y);
+	if (!tree->arena)
+		free(y);
 	return 0;
 }
 
@@ -0,0 +1,459 @@
+#define _GNU_SOURCE
+
+#include <time.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include "config.h"
+#include "logger.h"
+#include "framer.h"
+#include "shmrng.h"
+
+#ifdef ENABLE_SHM
+#include <linux/futex.h>
+
+#define SHMRNG_MAGIC 0x676e7273
+#define SHMRNG_AREA 4096
+#define SHMRNG_SPIN 256
+#define SHMRNG_TIMEOUT 1
+
+typedef struct shmrng_ring_s shmrng_ring_t;
+typedef struct shmrng_area_s shmrng_area_t;
+
+// shared by both processes, every counter is written by one side only
+struct shmrng_ring_s {
+
+	volatile uint32_t head __attribute__((aligned(64)));
+	volatile uint32_t tail __attribute__((aligned(64)));
+
+	// futex word, bumped on every head or tail move
+	volatile uint32_t seq __attribute__((aligned(64)));
+	volatile uint32_t waiters;
+};
+
+struct shmrng_area_s {
+
+	uint32_t magic;
+	uint32_t size;
+
+	// ring 0 carries requests, ring 1 carries answers
+	shmrng_ring_t ring[2];
+};
+
+struct shmrng_s {
+
+	int sock;
+
+	shmrng_area_t* area;
+	size_t length;
+
+	shmrng_ring_t* in;
+	shmrng_ring_t* out;
+	char* rdata;
+	char* wdata;
+	uint32_t size;
+	int spin;
+
+	// private positions, published to the peer once per frame
+	uint32_t head;
+	uint32_t tail;
+
+	char* buffer;
+	uint32_t used;
+
+	// set by shmrng_interrupt, the reader returns between frames
+	volatile int interrupt;
+
+	// milliseconds one read or write may wait for the peer, 0 waits while it is alive
+	int timeout;
+	struct timespec until;
+};
+
+static int shmrng_alive(shmrng_t* shm) {
+
+	char c;
+	int res = recv(shm->sock, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+	return res > 0 || (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR));
+}
+
+static void shmrng_wake(shmrng_ring_t* ring) {
+
+	__sync_fetch_and_add(&ring->seq, 1);
+	if (ring->waiters)
+		syscall(SYS_futex, &ring->seq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+static int shmrng_wait(shmrng_t* shm, shmrng_ring_t* ring, uint32_t seq) {
+
+	// the peer usually moves within microseconds, spin before sleeping
+	int spin;
+	for (spin = 0; spin < shm->spin; spin ++) {
+		if (ring->seq != seq)
+			return 0;
+#if defined(__x86_64__) || defined(__i386__)
+		__builtin_ia32_pause();
+#endif
+	}
+
+	struct timespec timeout = { .tv_sec = SHMRNG_TIMEOUT, .tv_nsec = 0 };
+
+	// stalled peer times the call out, it may be alive but never move
+	if (shm->timeout) {
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+
+		long left = (shm->until.tv_sec - now.tv_sec) * 1000000000L + (shm->until.tv_nsec - now.tv_nsec);
+		if (left <= 0) {
+			errno = EAGAIN;
+			return -1;
+		}
+
+		if (left < SHMRNG_TIMEOUT * 1000000000L) {
+			timeout.tv_sec = left / 1000000000L;
+			timeout.tv_nsec = left % 1000000000L;
+		}
+	}
+
+	__sync_fetch_and_add(&ring->waiters, 1);
+	int res = syscall(SYS_futex, &ring->seq, FUTEX_WAIT, seq, &timeout, NULL, 0);
+	__sync_fetch_and_sub(&ring->waiters, 1);
+
+	if (res == -1 && errno == ETIMEDOUT && !shmrng_alive(shm))
+		return -1;
+
+	return 0;
+}
+
+static void shmrng_deadline(shmrng_t* shm) {
+
+	if (!shm->timeout)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &shm->until);
+	shm->until.tv_sec += shm->timeout / 1000;
+	shm->until.tv_nsec += (shm->timeout % 1000) * 1000000L;
+	if (shm->until.tv_nsec >= 1000000000L) {
+		shm->until.tv_sec ++;
+		shm->until.tv_nsec -= 1000000000L;
+	}
+}
+
+static void shmrng_publish(shmrng_t* shm) {
+
+	if (shm->out->tail != shm->tail) {
+		__sync_synchronize();
+		shm->out->tail = shm->tail;
+		shmrng_wake(shm->out);
+	}
+
+	if (shm->in->head != shm->head) {
+		__sync_synchronize();
+		shm->in->head = shm->head;
+		shmrng_wake(shm->in);
+	}
+}
+
+static int shmrng_send(shmrng_t* shm, const char* src, uint32_t len) {
+
+	while (len) {
+		uint32_t seq = shm->out->seq;
+		__sync_synchronize();
+
+		uint32_t part = shm->size - (shm->tail - shm->out->head);
+		__sync_synchronize();
+		if (!part) {
+			shmrng_publish(shm);
+			if (shmrng_wait(shm, shm->out, seq))
+				return -1;
+			continue;
+		}
+
+		if (part > len)
+			part = len;
+
+		uint32_t pos = shm->tail & (shm->size - 1);
+		uint32_t first = shm->size - pos < part ? shm->size - pos : part;
+		memcpy(&shm->wdata[pos], src, first);
+		memcpy(shm->wdata, &src[first], part - first);
+
+		shm->tail += part;
+		src += part;
+		len -= part;
+	}
+
+	return 0;
+}
+
+static int shmrng_recv(shmrng_t* shm, char* dst, uint32_t len) {
+
+	while (len) {
+		uint32_t seq = shm->in->seq;
+		__sync_synchronize();
+
+		uint32_t part = shm->in->tail - shm->head;
+		__sync_synchronize();
+		if (!part) {
+			shmrng_publish(shm);
+			if (shmrng_wait(shm, shm->in, seq))
+				return -1;
+			continue;
+		}
+
+		if (part > len)
+			part = len;
+
+		uint32_t pos = shm->head & (shm->size - 1);
+		uint32_t first = shm->size - pos < part ? shm->size - pos : part;
+		memcpy(dst, &shm->rdata[pos], first);
+		memcpy(&dst[first], shm->rdata, part - first);
+
+		shm->head += part;
+		dst += part;
+		len -= part;
+	}
+
+	return 0;
+}
+
+static shmrng_t* shmrng_map(int sock, int fd, int side) {
+
+	struct stat st;
+	if (fstat(fd, &st) || st.st_size <= SHMRNG_AREA)
+		return NULL;
+
+	shmrng_t* shm = calloc(1, sizeof(*shm));
+	if (!shm)
+		return NULL;
+
+	shm->sock = sock;
+	shm->length = st.st_size;
+	shm->area = mmap(NULL, shm->length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (shm->area == MAP_FAILED) {
+		free(shm);
+		return NULL;
+	}
+
+	shm->size = shm->area->size;
+	if (shm->area->magic != SHMRNG_MAGIC || !shm->size || (shm->size & (shm->size - 1)) || SHMRNG_AREA + 2 * (size_t)shm->size > shm->length) {
+		ERROR("invalid shared memory ring");
+		munmap(shm->area, shm->length);
+		free(shm);
+		return NULL;
+	}
+
+	// spinning only helps when the peer runs on another cpu
+	shm->spin = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SHMRNG_SPIN : 0;
+
+	char* data = (char*)shm->area + SHMRNG_AREA;
+	shm->in = &shm->area->ring[side];
+	shm->out = &shm->area->ring[!side];
+	shm->rdata = &data[side * shm->size];
+	shm->wdata = &data[!side * shm->size];
+	return shm;
+}
+
+shmrng_t* shmrng_accept(int sock, uint32_t size) {
+
+	// ring positions wrap with uint32_t, size must be a power of two
+	if (!size || (size & (size - 1)))
+		return NULL;
+
+	int fd = memfd_create("vmixer-shm", MFD_CLOEXEC);
+	if (fd == -1) {
+		ERROR("memfd_create: %s", strerror(errno));
+		return NULL;
+	}
+
+	shmrng_area_t area = { .magic = SHMRNG_MAGIC, .size = size };
+	shmrng_t* shm = NULL;
+
+	if (ftruncate(fd, SHMRNG_AREA + 2 * (off_t)size) || pwrite(fd, &area, sizeof(area), 0) != sizeof(area))
+		ERROR("shared memory ring: %s", strerror(errno));
+
+	else if ((shm = shmrng_map(sock, fd, 0))) {
+		char c = 0;
+		char control[CMSG_SPACE(sizeof(int))] = { 0 };
+		struct iovec iov = { .iov_base = &c, .iov_len = 1 };
+		struct msghdr msg = {
+			.msg_iov = &iov,
+			.msg_iovlen = 1,
+			.msg_control = control,
+			.msg_controllen = sizeof(control),
+		};
+
+		struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+		if (sendmsg(sock, &msg, MSG_NOSIGNAL) != 1) {
+			ERROR("sendmsg: %s", strerror(errno));
+			shmrng_destroy(shm);
+			shm = NULL;
+		}
+	}
+
+	close(fd);
+	return shm;
+}
+
+shmrng_t* shmrng_connect(int sock) {
+
+	char c;
+	char control[CMSG_SPACE(sizeof(int))];
+	struct iovec iov = { .iov_base = &c, .iov_len = 1 };
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = control,
+		.msg_controllen = sizeof(control),
+	};
+
+	if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != 1)
+		return NULL;
+
+	struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+	if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+		return NULL;
+
+	int fd;
+	memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+
+	shmrng_t* shm = shmrng_map(sock, fd, 1);
+	close(fd);
+	return shm;
+}
+
+void shmrng_destroy(void* data) {
+
+	if (data) {
+		shmrng_t* shm = data;
+		munmap(shm->area, shm->length);
+		free(shm->buffer);
+		free(data);
+	}
+}
+
+// wait for the next frame, a started frame is always read to its end
+static int shmrng_next(shmrng_t* shm) {
+
+	while (1) {
+		uint32_t seq = shm->in->seq;
+		__sync_synchronize();
+
+		if (__sync_lock_test_and_set(&shm->interrupt, 0)) {
+			errno = EINTR;
+			return -1;
+		}
+
+		if (shm->in->tail != shm->head)
+			return 0;
+
+		shmrng_publish(shm);
+		if (shmrng_wait(shm, shm->in, seq))
+			return -1;
+	}
+}
+
+int shmrng_read(shmrng_t* shm, uint32_t* flags, uint32_t* id, const char* *buffer, uint32_t* size) {
+
+	shmrng_deadline(shm);
+
+	uint32_t len;
+	if (shmrng_next(shm) || shmrng_recv(shm, (char*)&len, HEADER_MSG_SIZE))
+		return -1;
+
+	*id = 0;
+	if (len & FRAME_FLAG_ID)
+		if (shmrng_recv(shm, (char*)id, FRAME_ID_SIZE))
+			return -1;
+
+	*flags = len & ~FRAME_SIZE_MASK;
+	*size = len & FRAME_SIZE_MASK;
+	if (*size > IO_BUFFER_SIZE)
+		return -1;
+
+	if (*size + 1 > shm->used) {
+		char* data = realloc(shm->buffer, *size + 1);
+		if (!data)
+			return -1;
+
+		shm->buffer = data;
+		shm->used = *size + 1;
+	}
+
+	if (shmrng_recv(shm, shm->buffer, *size))
+		return -1;
+
+	shmrng_publish(shm);
+	*buffer = shm->buffer;
+	return 0;
+}
+
+int shmrng_write(shmrng_t* shm, uint32_t flags, uint32_t id, const char* buffer, uint32_t size) {
+
+	shmrng_deadline(shm);
+
+	uint32_t header[2] = { size | flags, id };
+	uint32_t hsize = HEADER_MSG_SIZE + ((flags & FRAME_FLAG_ID) ? FRAME_ID_SIZE : 0);
+
+	if (shmrng_send(shm, (char*)header, hsize) || shmrng_send(shm, buffer, size))
+		return -1;
+
+	shmrng_publish(shm);
+	return 0;
+}
+
+void shmrng_interrupt(shmrng_t* shm) {
+
+	// seq is bumped after the flag, a reader going to sleep sees one of them
+	__sync_lock_test_and_set(&shm->interrupt, 1);
+	shmrng_wake(shm->in);
+}
+
+void shmrng_timeout(shmrng_t* shm, int timeout) {
+
+	shm->timeout = timeout > 0 ? timeout : 0;
+}
+
+#else
+
+shmrng_t* shmrng_accept(int sock, uint32_t size) {
+
+	errno = ENOSYS;
+	return NULL;
+}
+
+shmrng_t* shmrng_connect(int sock) {
+
+	errno = ENOSYS;
+	return NULL;
+}
+
+void shmrng_destroy(void* data) {
+
+	free(data);
+}
+
+int shmrng_read(shmrng_t* shm, uint32_t* flags, uint32_t* id, const char* *buffer, uint32_t* size) {
+
+	return -1;
+}
+
+int shmrng_write(shmrng_t* shm, uint32_t flags, uint32_t id, const char* buffer, uint32_t size) {
+
+	return -1;
+}
+void shmrng_interrupt(shmrng_t* shm) {
+}
+
+void shmrng_timeout(shmrng_t* shm, int timeout) {
+}
+#endif
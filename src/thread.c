@@ -14,6 +14,20 @@ struct locker_s {
 	int writed;
 };
 
+struct completion_s {
+
+	json_node_t* answer;
+	int owned;
+
+	void (*done_f)(void* data, json_node_t* answer);
+	void* data;
+
+	deadline_t* deadline;
+};
+
+// deadline of the request being called, async methods get it through completion
+static __thread deadline_t* deadline_current = NULL;
+
 struct thread_s {
 
 	char name[128];
@@ -22,13 +36,46 @@ struct thread_s {
 	pthread_cond_t cond;
 	pthread_mutex_t mutex;
 	thread_state_t state;
+	thread_state_t notified;
 	locker_t* locker;
 	module_t* module;
 	propes_t* props;
 
+	// calls in flight, the thread is destroyed after they return
+	pthread_cond_t idle;
+	int calls;
+
 	void* data;
 };
 
+static void (*thread_observe_f)(void* data, thread_t* thread, thread_event_t event, const char* name, const char* value) = NULL;
+static void* thread_observe_data = NULL;
+
+// transitions faster than the observer are reported as the state reached
+static void thread_changed(thread_t* thread) {
+
+	pthread_mutex_lock(&thread->mutex);
+	thread_state_t state = thread->state;
+	int changed = state != thread->notified;
+	thread->notified = state;
+	pthread_mutex_unlock(&thread->mutex);
+
+	if (changed && thread_observe_f)
+		thread_observe_f(thread_observe_data, thread, THREAD_EVENT_STATE, "state", thread_state_str(state));
+}
+
+static void thread_property(void* data, property_t* property, const char* value) {
+
+	if (thread_observe_f)
+		thread_observe_f(thread_observe_data, data, THREAD_EVENT_PROPERTY, property->name, value);
+}
+
+void thread_observe(void (*observe_f)(void* data, thread_t* thread, thread_event_t event, const char* name, const char* value), void* data) {
+
+	thread_observe_data = data;
+	thread_observe_f = observe_f;
+}
+
 static void routine(thread_t* thread) {
 
 	DEBUG("\'%s\':\'%s\' [%lu] routine(%p) started", thread_module(thread)->name, thread_name(thread), pthread_self(), thread->module->routine_f);
@@ -52,13 +99,16 @@ thread_t* thread_create(module_t* module, const char* name) {
 
 	thread->props = propes_create(module->props);
 	thread->state = THREAD_STATE_STOPPED;
+	thread->notified = THREAD_STATE_STOPPED;
 	thread->locker = locker_create();
 	thread->module = module;
+	propes_observe(thread->props, thread_property, thread);
 
 	DEBUG("\'%s\':\'%s\' create request", thread_module(thread)->name, thread_name(thread));
 
 	pthread_mutex_init(&thread->mutex, NULL);
 	pthread_cond_init(&thread->cond, NULL);
+	pthread_cond_init(&thread->idle, NULL);
 
 	if (thread->module->on_create_f) {
 		DEBUG("\'%s\':\'%s\' on_create(%p) started", thread_module(thread)->name, thread_name(thread), thread->module->on_create_f);
@@ -79,6 +129,12 @@ void thread_destroy(void* data) {
 
 	DEBUG("\'%s\':\'%s\' destroy request", thread_module(thread)->name, thread_name(thread));
 
+	// the thread is out of the pool, no new call can take it
+	pthread_mutex_lock(&thread->mutex);
+	while (thread->calls)
+		pthread_cond_wait(&thread->idle, &thread->mutex);
+	pthread_mutex_unlock(&thread->mutex);
+
 	if (thread_state(thread) != THREAD_STATE_STOPPED) {
 		thread_state_set(thread, THREAD_STATE_STOPPED);
 		DEBUG("\'%s\':\'%s\' return to destroy", thread_module(thread)->name, thread_name(thread));
@@ -98,10 +154,12 @@ void thread_destroy(void* data) {
 	propes_destroy(thread->props);
 	locker_destroy(thread->locker);
 
+	pthread_cond_destroy(&thread->idle);
 	pthread_cond_destroy(&thread->cond);
 	pthread_mutex_destroy(&thread->mutex);
 
 	INFO("\'%s\':\'%s\' destroy complete success.", thread_module(thread)->name, thread_name(thread));
+	free(thread);
 }
 
 const char* thread_state_str(thread_state_t state) {
@@ -132,6 +190,8 @@ void thread_update(thread_t* thread, thread_state_t state) {
 	pthread_cond_broadcast(&thread->cond);
 	DEBUG("\'%s\':\'%s\' [%lu] update state set to \"%s\"", thread_module(thread)->name, thread_name(thread), pthread_self(), thread_state_str(thread->state));
 	pthread_mutex_unlock(&thread->mutex);
+
+	thread_changed(thread);
 }
 
 void thread_state_set(thread_t* thread, thread_state_t state) {
@@ -232,6 +292,28 @@ void thread_state_set(thread_t* thread, thread_state_t state) {
 	}
 
 	locker_set(thread->locker, THREAD_UNLOCK_WRITE);
+	thread_changed(thread);
+}
+
+void thread_acquire(thread_t* thread) {
+
+	if (!thread)
+		return;
+
+	pthread_mutex_lock(&thread->mutex);
+	thread->calls ++;
+	pthread_mutex_unlock(&thread->mutex);
+}
+
+void thread_release(thread_t* thread) {
+
+	if (!thread)
+		return;
+
+	pthread_mutex_lock(&thread->mutex);
+	if (!-- thread->calls)
+		pthread_cond_broadcast(&thread->idle);
+	pthread_mutex_unlock(&thread->mutex);
 }
 
 thread_state_t thread_run_wait(thread_t* thread) {
@@ -414,3 +496,99 @@ int thread_info(thread_t* thread, json_node_t* info) {
 	locker_set(thread->locker, THREAD_UNLOCK_READ);
 	return 0;
 }
+
+completion_t* completion_create(json_node_t* answer, void (*done_f)(void* data, json_node_t* answer), void* data) {
+
+	if (!done_f)
+		return NULL;
+
+	completion_t* completion = calloc(1, sizeof(*completion));
+	if (!completion)
+		return NULL;
+
+	// answer outlives the request, it is kept out of the request arena
+	if (!answer) {
+		arenas_t* arena = json_node_arena(NULL);
+		answer = json_node_object(NULL);
+		json_node_arena(arena);
+		completion->owned = !0;
+	}
+
+	if (!answer) {
+		free(completion);
+		return NULL;
+	}
+
+	completion->answer = answer;
+	completion->done_f = done_f;
+	completion->data = data;
+	completion->deadline = deadline_current;
+	return completion;
+}
+
+json_node_t* completion_answer(completion_t* completion) {
+
+	if (!completion)
+		return NULL;
+
+	return completion->answer;
+}
+
+void completion_done(completion_t* completion) {
+
+	if (!completion)
+		return;
+
+	completion->done_f(completion->data, completion->answer);
+
+	if (completion->owned)
+		json_node_destroy(completion->answer);
+
+	free(completion);
+}
+
+static long deadline_left(deadline_t* deadline) {
+
+	if (!deadline)
+		return -1;
+
+	if (deadline->cancel && *deadline->cancel)
+		return 0;
+
+	if (!deadline->set)
+		return -1;
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	// part of millisecond left is still budget
+	long usec = (deadline->at.tv_sec - now.tv_sec) * 1000000L + (deadline->at.tv_nsec - now.tv_nsec) / 1000;
+	return usec > 0 ? (usec + 999) / 1000 : 0;
+}
+
+long completion_remaining(completion_t* completion) {
+
+	return completion ? deadline_left(completion->deadline) : -1;
+}
+
+int completion_cancelled(completion_t* completion) {
+
+	return !completion_remaining(completion);
+}
+
+deadline_t* deadline_enter(deadline_t* deadline) {
+
+	deadline_t* previous = deadline_current;
+	deadline_current = deadline;
+	return previous;
+}
+
+long deadline_remaining() {
+
+	return deadline_left(deadline_current);
+}
+
+int deadline_cancelled() {
+
+	return !deadline_left(deadline_current);
+}
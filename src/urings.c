@@ -0,0 +1,192 @@
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "config.h"
+#include "logger.h"
+#include "urings.h"
+
+#ifdef ENABLE_URING
+#include <linux/io_uring.h>
+
+struct urings_s {
+
+	int fd;
+
+	struct {
+		unsigned int* head;
+		unsigned int* tail;
+		unsigned int* mask;
+		unsigned int* entries;
+		unsigned int* array;
+		struct io_uring_sqe* sqes;
+		unsigned int local;
+		unsigned int pending;
+	} sq;
+
+	struct {
+		unsigned int* head;
+		unsigned int* tail;
+		unsigned int* mask;
+		struct io_uring_cqe* cqes;
+	} cq;
+
+	void* sq_ptr;
+	size_t sq_len;
+	void* cq_ptr;
+	size_t cq_len;
+	size_t sqes_len;
+};
+
+urings_t* urings_create(unsigned int entries) {
+
+	urings_t* ring = calloc(1, sizeof(*ring));
+	if (!ring)
+		return NULL;
+
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+
+	if ((ring->fd = syscall(__NR_io_uring_setup, entries, &params)) == -1) {
+		ERROR("io_uring_setup: %s", strerror(errno));
+		free(ring);
+		return NULL;
+	}
+
+	ring->sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	ring->cq_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+
+	// both rings share one mapping on current kernels
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cq_len > ring->sq_len)
+			ring->sq_len = ring->cq_len;
+		ring->cq_len = 0;
+	}
+
+	ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	ring->cq_ptr = ring->cq_len ? mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING) : ring->sq_ptr;
+	ring->sq.sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+
+	if (ring->sq_ptr == MAP_FAILED || ring->cq_ptr == MAP_FAILED || ring->sq.sqes == MAP_FAILED) {
+		ERROR("io_uring mmap: %s", strerror(errno));
+		urings_destroy(ring);
+		return NULL;
+	}
+
+	char* sq = ring->sq_ptr;
+	ring->sq.head = (unsigned int*)(sq + params.sq_off.head);
+	ring->sq.tail = (unsigned int*)(sq + params.sq_off.tail);
+	ring->sq.mask = (unsigned int*)(sq + params.sq_off.ring_mask);
+	ring->sq.entries = (unsigned int*)(sq + params.sq_off.ring_entries);
+	ring->sq.array = (unsigned int*)(sq + params.sq_off.array);
+	ring->sq.local = *ring->sq.tail;
+
+	char* cq = ring->cq_ptr;
+	ring->cq.head = (unsigned int*)(cq + params.cq_off.head);
+	ring->cq.tail = (unsigned int*)(cq + params.cq_off.tail);
+	ring->cq.mask = (unsigned int*)(cq + params.cq_off.ring_mask);
+	ring->cq.cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+	return ring;
+}
+
+void urings_destroy(void* data) {
+
+	if (data) {
+		urings_t* ring = data;
+		if (ring->sq.sqes && ring->sq.sqes != MAP_FAILED)
+			munmap(ring->sq.sqes, ring->sqes_len);
+		if (ring->cq_len && ring->cq_ptr && ring->cq_ptr != MAP_FAILED)
+			munmap(ring->cq_ptr, ring->cq_len);
+		if (ring->sq_ptr && ring->sq_ptr != MAP_FAILED)
+			munmap(ring->sq_ptr, ring->sq_len);
+		close(ring->fd);
+		free(data);
+	}
+}
+
+struct io_uring_sqe* urings_sqe(urings_t* ring) {
+
+	if (ring->sq.local - __atomic_load_n(ring->sq.head, __ATOMIC_ACQUIRE) >= *ring->sq.entries) {
+		if (urings_submit(ring, 0) < 0)
+			return NULL;
+
+		if (ring->sq.local - __atomic_load_n(ring->sq.head, __ATOMIC_ACQUIRE) >= *ring->sq.entries)
+			return NULL;
+	}
+
+	unsigned int index = ring->sq.local & *ring->sq.mask;
+	struct io_uring_sqe* sqe = &ring->sq.sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	ring->sq.array[index] = index;
+	ring->sq.local ++;
+	ring->sq.pending ++;
+	return sqe;
+}
+
+int urings_submit(urings_t* ring, unsigned int wait) {
+
+	__atomic_store_n(ring->sq.tail, ring->sq.local, __ATOMIC_RELEASE);
+
+	while (1) {
+		int res = syscall(__NR_io_uring_enter, ring->fd, ring->sq.pending, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+		if (res >= 0) {
+			ring->sq.pending -= (unsigned int) res < ring->sq.pending ? (unsigned int) res : ring->sq.pending;
+			return res;
+		}
+
+		if (errno != EINTR)
+			return -1;
+	}
+}
+
+struct io_uring_cqe* urings_cqe(urings_t* ring) {
+
+	unsigned int head = *ring->cq.head;
+	if (head == __atomic_load_n(ring->cq.tail, __ATOMIC_ACQUIRE))
+		return NULL;
+
+	return &ring->cq.cqes[head & *ring->cq.mask];
+}
+
+void urings_seen(urings_t* ring) {
+
+	__atomic_store_n(ring->cq.head, *ring->cq.head + 1, __ATOMIC_RELEASE);
+}
+
+#else
+
+urings_t* urings_create(unsigned int entries) {
+
+	errno = ENOSYS;
+	return NULL;
+}
+
+void urings_destroy(void* data) {
+
+	free(data);
+}
+
+struct io_uring_sqe* urings_sqe(urings_t* ring) {
+
+	return NULL;
+}
+
+int urings_submit(urings_t* ring, unsigned int wait) {
+
+	errno = ENOSYS;
+	return -1;
+}
+
+struct io_uring_cqe* urings_cqe(urings_t* ring) {
+
+	return NULL;
+}
+
+void urings_seen(urings_t* ring) {
+}
+#endif
@@ -1,6 +1,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include "arenas.h"
 #include "vector.h"
 
 typedef struct vector_entry_s vector_entry_t;
@@ -26,6 +27,8 @@ struct vector_s {
 	int blks;
 	int used;
 	int size;
+
+	arenas_t* arena;
 };
 
 struct vector_iterator_s {
@@ -47,6 +50,20 @@ vector_t* vector_create(int blks, void (*destroy_data_f)(void*)) {
 	return vector;
 }
 
+vector_t* vector_arena(arenas_t* arena, int blks, void (*destroy_data_f)(void*)) {
+
+	vector_t* vector = arenas_alloc(arena, sizeof(*vector));
+	if (vector) {
+		vector->destroy_data_f = destroy_data_f;
+		vector->arena = arena;
+		if (blks <= 1)
+			vector->blks = 1;
+		else	vector->blks = blks;
+	}
+
+	return vector;
+}
+
 void vector_destroy(void* data) {
 
 	if (!data)
@@ -61,6 +78,10 @@ void vector_destroy(void* data) {
 		}
 	}
 
+	// arena vector memory goes away with arena reset
+	if (vector->arena)
+		return;
+
 	if (vector->data)
 		free(vector->data);
 
@@ -91,20 +112,21 @@ int set_to_vector(vector_t* vector, void* data) {
 	if (!vector || !data)
 		return -1;
 
-	if (vector->size == vector->used) {
-		if (vector_resize(vector, vector->size + vector->blks))
+	int id = vector->size;
+	while (id > 0 && vector->data[id - 1].used == VECTOR_ENTRY_FREE)
+		id --;
+
+	if (id == vector->size) {
+		// arena keeps every outgrown block until reset, so arena vectors grow by doubling
+		int blks = (vector->arena && vector->used > vector->blks) ? vector->used : vector->blks;
+		if (vector_resize(vector, vector->used + blks))
 			return -1;
+		id = vector->used;
 	}
 
-	int id = vector->size;
-	while (id --) {
-		if (vector->data[id].used == VECTOR_ENTRY_FREE) {
-			vector->data[id].used = VECTOR_ENTRY_USED;
-			vector->data[id].data = data;
-			vector->used++;
-			break;
-		}
-	}
+	vector->data[id].used = VECTOR_ENTRY_USED;
+	vector->data[id].data = data;
+	vector->used++;
 
 	return 0;
 }
@@ -158,13 +180,13 @@ int vector_resize(vector_t* vector, int size) {
 		return -1;
 
 	if (size > 0) {
-		vector_entry_t* data = calloc(size, sizeof(*data));
+		vector_entry_t* data = vector->arena ? arenas_alloc(vector->arena, size * sizeof(*data)) : calloc(size, sizeof(*data));
 		if (!data)
 			return -1;
 
 		int new_id = 0;
-		int old_id = vector->size;
-		while (old_id -- ) {
+		int old_id;
+		for (old_id = 0; old_id < vector->size; old_id ++) {
 			if (vector->data[old_id].used == VECTOR_ENTRY_USED) {
 				data[new_id].data = vector->data[old_id].data;
 				data[new_id].used = VECTOR_ENTRY_USED;
@@ -172,14 +194,14 @@ int vector_resize(vector_t* vector, int size) {
 			}
 		}
 
-		if (vector->data)
+		if (vector->data && !vector->arena)
 			free(vector->data);
 
 		vector->data = data;
 	}
 
 	else {
-		if (vector->data)
+		if (vector->data && !vector->arena)
 			free(vector->data);
 		vector->data = NULL;
 	}
@@ -1,341 +1,4518 @@
+#define _GNU_SOURCE
+
 
 #include <pwd.h>
 #include <grp.h>
+#include <time.h>
 #include <stdio.h>
 #include <errno.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <signal.h>
 #include <getopt.h>
 #include <limits.h>
 #include <sys/un.h>
+#include <stdint.h>
 #include <pthread.h>
 #include <sys/types.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <sys/select.h>
+#include <poll.h>
 #include <netinet/in.h>
 
-#include "config.h"
-#include "propes.h"
-#include "client.h"
-#include "thread.h"
-#include "vector.h"
-#include "rbtree.h"
-#include "addres.h"
-#include "loader.h"
-#include "logger.h"
+#include "config.h"
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+#ifdef ENABLE_URING
+#include <linux/io_uring.h>
+#endif
+
+#include "propes.h"
+#include "client.h"
+#include "thread.h"
+#include "vector.h"
+#include "rbtree.h"
+#include "addres.h"
+#include "loader.h"
+#include "logger.h"
+#include "worker.h"
+#include "framer.h"
+#include "shmrng.h"
+#include "urings.h"
+#include "arenas.h"
+#include "epochs.h"
+#include "wheels.h"
+
+#define LISTEN_COUNT SOMAXCONN
+#define REACTOR_EVENTS 64
+#define UDP_BATCH 32
+#define ARENA_SIZE 16384
+#define CONFDIR_SLOWEST 5
+#define HANDLE_BLOCK 64
+#define HANDLE_BLOCKS 64
+#define SHUTDOWN_GRACE 10
+#define SHUTDOWN_POLL_MS 10
+#define IDLE_TICK_MS 1000
+#define EVENT_QUEUE_DEPTH 256
+#define EVENT_PRINT_SIZE (2 * VALUE_LEN_MAX)
+#define STREAM_BUDGET (IO_BUFFER_SIZE / 2)
+
+#define URING_ENTRIES 256
+#define URING_BUFFERS 256
+#define URING_BUFFER_SIZE 16384
+#define URING_GROUP 1
+
+// io_uring user_data is a pointer tagged with the operation in its low bits
+#define URING_ACCEPT 1
+#define URING_RECV 2
+#define URING_SEND 3
+#define URING_EVENT 4
+#define URING_BUFFER 5
+#define URING_TIMER 6
+#define URING_CANCEL 7
+#define URING_MASK 7
+
+typedef struct server_s server_t;
+typedef struct connect_s connect_t;
+typedef struct reactor_s reactor_t;
+typedef struct job_s job_t;
+typedef struct shard_s shard_t;
+typedef struct stream_s stream_t;
+typedef struct send_s send_t;
+typedef struct batch_s batch_t;
+typedef struct confdir_s confdir_t;
+typedef struct config_s config_t;
+typedef struct handle_s handle_t;
+typedef struct resolve_s resolve_t;
+typedef struct subscribe_s subscribe_t;
+typedef struct event_s event_t;
+typedef struct dgram_s dgram_t;
+typedef struct udp_s udp_t;
+typedef struct answer_s answer_t;
+
+struct connect_s {
+
+	int sock;
+	struct sockaddr_in client;
+
+	server_t* server;
+	shard_t* shard;
+	parser_t* parser;
+	framer_t* framer;
+	shmrng_t* shm;
+	reactor_t* reactor;
+	arenas_t* arena;
+
+	pthread_cond_t cond;
+	pthread_mutex_t mutex;
+	int refs;
+	int busy;
+	int events;
+
+	// client is gone, calls still running see it as cancellation
+	int closed;
+
+	// datagrams of every peer share the connection, per client state is refused
+	int datagram;
+
+	struct {
+		uint32_t flags;
+		uint32_t id;
+		uint32_t used;
+		int held;
+		char* buffer;
+	} in;
+
+	struct {
+		uint32_t size;
+		uint32_t writed;
+		char* buffer;
+
+		// reactor connections print queued answers a chunk at a time as the socket takes them
+		answer_t* head;
+		answer_t* tail;
+
+		// thread connections write one answer at a time, others wait for it to end
+		int streaming;
+	} out;
+
+	struct {
+		send_t* head;
+		send_t* tail;
+		send_t* retry;
+		send_t* last;
+		int flight;
+		int ready;
+		int closed;
+		// multishot recv armed, stopped while input is held by admission
+		int recv;
+		int stopped;
+		connect_t* next;
+	} uring;
+
+	struct {
+		int count;
+		int reqst;
+	} stat;
+
+	struct {
+		connect_t* next;
+		int paused;
+	} admit;
+
+	struct {
+		handle_t* block[HANDLE_BLOCKS];
+		uint32_t count;
+	} handle;
+
+	// subscriptions of this connection, removed when it is released, changed atomically under subscribe mutex
+	int subscribed;
+
+	// pushed events wait here for the io context of the connection, new ones are dropped when full
+	struct {
+		// innermost lock, taken under conn and subscribe mutexes
+		pthread_mutex_t mutex;
+		event_t* head;
+		event_t* tail;
+		int count;
+		// connection thread polls it beside the socket
+		int wake[2];
+		// last event queued here, under subscribe mutex
+		uint64_t stamp;
+	} event;
+
+	// input moves last only, the wheel entry checks it when it expires
+	struct {
+		wheels_timer_t timer;
+		uint64_t last;
+	} idle;
+
+	// open connections of the server, stop closes those left
+	struct {
+		connect_t* prev;
+		connect_t* next;
+	} link;
+};
+
+struct reactor_s {
+
+	int epfd;
+	pthread_t td;
+	server_t* server;
+	shard_t* shard;
+
+	urings_t* uring;
+	// wakes the reactor thread, epoll reactors get it only to stop
+	int evfd;
+	uint64_t event;
+	int stop;
+	char* buffers;
+	pthread_mutex_t mutex;
+	connect_t* ready;
+
+	// connections of this reactor by last input, listener thread adds under mutex
+	struct {
+		wheels_t* wheel;
+		pthread_mutex_t mutex;
+		uint64_t now;
+#ifdef ENABLE_URING
+		struct __kernel_timespec tick;
+#endif
+	} idle;
+};
+
+struct send_s {
+
+	connect_t* conn;
+	send_t* next;
+	char* buffer;
+	uint32_t size;
+	uint32_t sent;
+};
+
+struct shard_s {
+
+	int sock;
+
+	pthread_t td;
+	pthread_mutex_t mutex;
+
+	server_t* server;
+
+	struct {
+		uint64_t accepted;
+		uint64_t failed;
+		uint64_t wakeups;
+		int burst_max;
+		int rate;
+		int rate_max;
+		int current;
+		time_t second;
+	} stat;
+};
+
+struct job_s {
+
+	connect_t* conn;
+	arenas_t* arena;
+	json_node_t* request;
+	uint32_t flags;
+	uint32_t id;
+	int kick;
+	struct timespec queued;
+	deadline_t deadline;
+
+	// a deferred job is finished by whichever of job_run and its completion comes last
+	int deferred;
+	int refs;
+
+	// target of deferred call, pinned until its completion
+	loader_t* loader;
+	thread_t* thread;
+};
+
+// job run by this thread, async methods called outside of it are waited inline
+static __thread job_t* job_current = NULL;
+
+// one datagram request, answered by a worker and sent back by the listener
+struct dgram_s {
+
+	udp_t* udp;
+	dgram_t* next;
+	arenas_t* arena;
+	json_node_t* request;
+	deadline_t deadline;
+
+	uint32_t flags;
+	uint32_t id;
+	struct sockaddr_in client;
+	socklen_t namelen;
+
+	uint32_t size;
+	char reply[FRAME_DATAGRAM_SIZE];
+};
+
+struct udp_s {
+
+	connect_t* conn;
+	int sock;
+	int wake[2];
+
+	// answered datagrams waiting for sendmmsg, filled by workers
+	pthread_mutex_t mutex;
+	dgram_t* head;
+	dgram_t* tail;
+	int flight;
+
+	// owned by the listener thread
+	dgram_t* free;
+	int spare;
+};
+
+struct batch_s {
+
+	connect_t* conn;
+	server_t* server;
+	json_node_t** request;
+	json_node_t** answer;
+	int count;
+	int next;
+	int done;
+	int refs;
+	int parallel;
+	deadline_t* deadline;
+
+	pthread_cond_t cond;
+	pthread_mutex_t mutex;
+};
+
+struct handle_s {
+
+	char* module;
+	char* thread;
+	char* method;
+	resolve_t* resolve;
+};
+
+// resolved pointers are valid while registry and pool generations are the same
+struct resolve_s {
+
+	uint64_t generation;
+	uint64_t pool;
+	loader_t* loader;
+	thread_t* thread;
+	method_t* method;
+};
+
+struct event_s {
+
+	event_t* next;
+	uint32_t size;
+	char body[];
+};
+
+struct answer_s {
+
+	answer_t* next;
+	uint32_t flags;
+	uint32_t id;
+	uint32_t total;
+
+	// tree owned with its arena, printed by the cursor
+	json_node_t* node;
+	arenas_t* arena;
+	json_cursor_t* cursor;
+
+	// frames printed before queueing
+	char* out;
+	uint32_t size;
+};
+
+struct subscribe_s {
+
+	connect_t* conn;
+	char* module;
+	char* thread;
+	uint32_t id;
+	subscribe_t* next;
+};
+
+struct config_s {
+
+	char* name;
+	json_node_t* request;
+	int order;
+	uint64_t parse;
+	uint64_t apply;
+};
+
+struct confdir_s {
+
+	config_t* config;
+	int count;
+	int next;
+};
+
+struct stream_s {
+
+	connect_t* conn;
+	uint32_t flags;
+	uint32_t id;
+	uint32_t used;
+	uint32_t total;
+	char chunk[IO_BUFFER_SIZE];
+
+	// framed chunks waiting for the reactor out buffer or send queue
+	char* out;
+	uint32_t size;
+};
+
+struct server_s {
+
+	int shards;
+	int backlog;
+	shard_t* shard;
+
+	address_t* address;
+	// published registry snapshot, replaced under reload mutex
+	rbtree_t* loader;
+	uint64_t generation;
+	pthread_mutex_t reload;
+
+	int reactors;
+	int uring;
+	reactor_t* reactor;
+
+	int workers;
+	int depth;
+	worker_t* worker;
+
+	struct {
+		int count;
+		int connections;
+		int flight;
+		uint64_t reqst;
+		uint64_t expired;
+		uint64_t reaped;
+		int running;
+		time_t started;
+		struct timespec start;
+	} stat;
+
+	struct {
+		int connections;
+		int flight;
+		int conn;
+		int pause;
+
+		pthread_mutex_t mutex;
+		connect_t* paused;
+
+		uint64_t refused;
+		uint64_t rejected;
+		uint64_t pauses;
+		uint64_t admitted;
+		uint64_t delay_total;
+		uint64_t delay_max;
+	} admit;
+
+	struct {
+		pthread_mutex_t mutex;
+		subscribe_t* list;
+		uint32_t id;
+		int count;
+		uint64_t events;
+		uint64_t dropped;
+		uint64_t stamp;
+	} subscribe;
+
+	// open connections, linked by their constructors and unlinked on release
+	struct {
+		pthread_mutex_t mutex;
+		connect_t* head;
+	} open;
+
+	// set once by signal, listeners are closed and new requests refused,
+	// seq_cst with stat.running so stop and a starting call see each other
+	int stopping;
+	int grace;
+
+	// seconds without input before a connection is closed, 0 keeps it
+	int idle;
+
+	char* confdir;
+	char* user;
+	char* group;
+};
+
+static void server_accept_info(server_t* server, json_node_t* info);
+static void server_admit_info(server_t* server, json_node_t* info);
+
+static int server_stopping(server_t* server) {
+
+	return __atomic_load_n(&server->stopping, __ATOMIC_SEQ_CST);
+}
+static void job_complete(void* data, json_node_t* answer);
+
+// publish registry with loader added or replaced, old snapshot is destroyed by caller after epochs_synchronize
+static rbtree_t* server_register(server_t* server, loader_t* loader) {
+
+	rbtree_t* loaders = server->loader;
+	rbtree_t* copy = rbtree_clone(loaders);
+
+	if (!copy || set_to_rbtree(copy, loader_module(loader)->name, loader)) {
+		rbtree_destroy(copy);
+		return NULL;
+	}
+
+	epochs_publish((void**)&server->loader, copy);
+	__atomic_add_fetch(&server->generation, 1, __ATOMIC_SEQ_CST);
+	return loaders;
+}
+
+static void kernel_modules(connect_t* conn, server_t* server, json_node_t* args, json_node_t* answer) {
+
+	epochs_enter();
+	rbtree_iterator_t* it = rbtree_iterator_create(epochs_load((void**)&server->loader));
+
+	const char* key;
+	void* data;
+
+	while (rbtree_iterate(it, &key, &data)) {
+		json_node_t* module = json_node_object(NULL);
+		json_node_object_add(module, "threads", json_node_int(loader_threads(data)));
+		json_node_object_add(module, "file", json_node_string(loader_file(data)));
+		json_node_object_add(answer, key, module);
+	}
+	rbtree_iterator_destroy(it);
+	epochs_leave();
+}
+
+// new version is taken only from the directory the module was loaded from, path gets the resolved file
+static int kernel_reload_path(loader_t* loader, const char* file, char* path) {
+
+	char dir[PATH_MAX];
+	if (!realpath(loader_file(loader), dir) || !realpath(file, path))
+		return -1;
+
+	size_t size = strrchr(dir, '/') - dir + 1;
+	return strncmp(dir, path, size) || strchr(&path[size], '/') ? -1 : 0;
+}
+
+static void kernel_reload(connect_t* conn, server_t* server, json_node_t* args, json_node_t* answer) {
+
+	json_node_t* module = json_node_object_node(args, "module", JSON_NODE_TYPE_STRING);
+	json_node_t* file   = json_node_object_node(args, "file"  , JSON_NODE_TYPE_STRING);
+
+	// a datagram is not bound to a client, anybody could forge it
+	if (conn->datagram) {
+		json_node_object_add(answer, "error", json_node_string("reload needs stream connection"));
+		return;
+	}
+
+	if (!module) {
+		json_node_object_add(answer, "error", json_node_string("module required"));
+		return;
+	}
+
+	// registry entries are replaced only here, one reload at a time
+	pthread_mutex_lock(&server->reload);
+
+	char path[PATH_MAX];
+	loader_t* loader = get_from_rbtree(server->loader, json_node_string_value(module));
+	loader_t* reload = NULL;
+	rbtree_t* loaders = NULL;
+	const char* error = NULL;
+	if (!loader)
+		json_node_object_add(answer, "error", json_node_string("module not found"));
+
+	else if (file && kernel_reload_path(loader, json_node_string_value(file), path))
+		json_node_object_add(answer, "error", json_node_string("file not in module directory"));
+
+	else if (!(reload = loader_reload(loader, file ? path : NULL, &error)))
+		json_node_object_add(answer, "error", json_node_string(error ? error : "module not reloaded"));
+
+	else if (!(loaders = server_register(server, reload))) {
+		json_node_object_add(answer, "error", json_node_string("module not registered"));
+		loader_destroy(reload);
+	}
+
+	else {
+		// new calls reach the new version, the old one is dropped after its calls return
+		loader_retire(loader, reload);
+		rbtree_destroy(loaders);
+
+		json_node_object_add(answer, "module", json_node_string(loader_name(reload)));
+		json_node_object_add(answer, "file", json_node_string(loader_file(reload)));
+		json_node_object_add(answer, "threads", json_node_int(loader_threads(reload)));
+		INFO("module: '%s' reloaded from '%s'", loader_name(reload), loader_file(reload));
+	}
+
+	pthread_mutex_unlock(&server->reload);
+}
+
+static void kernel_stats(connect_t* conn, server_t* server, json_node_t* args, json_node_t* answer) {
+
+	// only counters and gauges are read here, polling stays cheap
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	json_node_object_add(answer, "started", json_node_long(server->stat.started));
+	json_node_object_add(answer, "uptime", json_node_long(now.tv_sec - server->stat.start.tv_sec));
+
+	json_node_t* connections = json_node_object(NULL);
+	json_node_object_add(connections, "current", json_node_int(__atomic_load_n(&server->stat.connections, __ATOMIC_RELAXED)));
+	json_node_object_add(connections, "total", json_node_int(__atomic_load_n(&server->stat.count, __ATOMIC_RELAXED)));
+	json_node_object_add(connections, "reaped", json_node_long(__atomic_load_n(&server->stat.reaped, __ATOMIC_RELAXED)));
+	json_node_object_add(answer, "connections", connections);
+
+	json_node_t* requests = json_node_object(NULL);
+	json_node_object_add(requests, "served", json_node_long(__atomic_load_n(&server->stat.reqst, __ATOMIC_RELAXED)));
+	json_node_object_add(requests, "flight", json_node_int(__atomic_load_n(&server->stat.flight, __ATOMIC_RELAXED)));
+	json_node_object_add(requests, "expired", json_node_long(__atomic_load_n(&server->stat.expired, __ATOMIC_RELAXED)));
+	json_node_object_add(answer, "requests", requests);
+
+	json_node_t* modules = json_node_object(NULL);
+	kernel_modules(conn, server, args, modules);
+	json_node_object_add(answer, "modules", modules);
+
+	if (server->worker) {
+		json_node_t* worker = json_node_object(NULL);
+		worker_info(server->worker, worker);
+		json_node_object_add(answer, "worker", worker);
+	}
+
+	json_node_t* accept = json_node_object(NULL);
+	server_accept_info(server, accept);
+	json_node_object_add(answer, "accept", accept);
+
+	json_node_t* admit = json_node_object(NULL);
+	server_admit_info(server, admit);
+	json_node_object_add(answer, "admit", admit);
+
+	json_node_t* subscribe = json_node_object(NULL);
+	json_node_object_add(subscribe, "current", json_node_int(__atomic_load_n(&server->subscribe.count, __ATOMIC_RELAXED)));
+	json_node_object_add(subscribe, "events", json_node_long(__atomic_load_n(&server->subscribe.events, __ATOMIC_RELAXED)));
+	json_node_object_add(subscribe, "dropped", json_node_long(__atomic_load_n(&server->subscribe.dropped, __ATOMIC_RELAXED)));
+	json_node_object_add(answer, "subscribe", subscribe);
+}
+
+static void subscribe_destroy(subscribe_t* subscribe) {
+
+	free(subscribe->module);
+	free(subscribe->thread);
+	free(subscribe);
+}
+
+static void kernel_subscribe(connect_t* conn, server_t* server, json_node_t* args, json_node_t* answer) {
+
+	json_node_t* module = json_node_object_node(args, "module", JSON_NODE_TYPE_STRING);
+	json_node_t* thread = json_node_object_node(args, "thread", JSON_NODE_TYPE_STRING);
+
+	// events are pushed as frames, datagrams and configuration have nobody to receive them
+	if (!conn->framer && !conn->shm) {
+		json_node_object_add(answer, "error", json_node_string("subscribe needs stream connection"));
+		return;
+	}
+
+	subscribe_t* subscribe = calloc(1, sizeof(*subscribe));
+	if (!subscribe || (module && !(subscribe->module = strdup(json_node_string_value(module))))
+		|| (thread && !(subscribe->thread = strdup(json_node_string_value(thread))))) {
+		json_node_object_add(answer, "error", json_node_string("out of memory"));
+		if (subscribe)
+			subscribe_destroy(subscribe);
+		return;
+	}
+
+	subscribe->conn = conn;
+
+	pthread_mutex_lock(&server->subscribe.mutex);
+	subscribe->id = ++ server->subscribe.id;
+	subscribe->next = server->subscribe.list;
+	__atomic_store_n(&server->subscribe.list, subscribe, __ATOMIC_RELEASE);
+	server->subscribe.count ++;
+	__atomic_add_fetch(&conn->subscribed, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&server->subscribe.mutex);
+
+	json_node_object_add(answer, "subscription", json_node_int(subscribe->id));
+}
+
+static void kernel_unsubscribe(connect_t* conn, server_t* server, json_node_t* args, json_node_t* answer) {
+
+	json_node_t* id = json_node_object_node(args, "subscription", JSON_NODE_TYPE_INTEGER);
+	if (!id) {
+		json_node_object_add(answer, "error", json_node_string("subscription required"));
+		return;
+	}
+
+	subscribe_t* subscribe = NULL;
+
+	pthread_mutex_lock(&server->subscribe.mutex);
+	subscribe_t** prev = &server->subscribe.list;
+	while (*prev) {
+		if ((*prev)->conn == conn && (*prev)->id == (uint32_t) json_node_int_value(id)) {
+			subscribe = *prev;
+			*prev = subscribe->next;
+			server->subscribe.count --;
+			__atomic_sub_fetch(&conn->subscribed, 1, __ATOMIC_SEQ_CST);
+			break;
+		}
+		prev = &(*prev)->next;
+	}
+	pthread_mutex_unlock(&server->subscribe.mutex);
+
+	if (!subscribe) {
+		json_node_object_add(answer, "error", json_node_string("subscription not found"));
+		return;
+	}
+
+	json_node_object_add(answer, "subscription", json_node_int(subscribe->id));
+	subscribe_destroy(subscribe);
+}
+
+static void connect_unsubscribe(connect_t* conn) {
+
+	server_t* server = conn->server;
+
+	pthread_mutex_lock(&server->subscribe.mutex);
+	subscribe_t** prev = &server->subscribe.list;
+	while (*prev && conn->subscribed) {
+		subscribe_t* subscribe = *prev;
+		if (subscribe->conn == conn) {
+			*prev = subscribe->next;
+			server->subscribe.count --;
+			__atomic_sub_fetch(&conn->subscribed, 1, __ATOMIC_SEQ_CST);
+			subscribe_destroy(subscribe);
+		}
+		else	prev = &subscribe->next;
+	}
+	pthread_mutex_unlock(&server->subscribe.mutex);
+}
+
+typedef struct {
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int done;
+} target_wait_t;
+
+static void target_wakeup(void* data, json_node_t* answer) {
+
+	target_wait_t* wait = data;
+	pthread_mutex_lock(&wait->mutex);
+	wait->done = 1;
+	pthread_cond_signal(&wait->cond);
+	pthread_mutex_unlock(&wait->mutex);
+}
+
+// pinned with target_acquire, the target is valid out of read section until target_release
+static void target_acquire(loader_t* loader, thread_t* thread) {
+
+	loader_acquire(loader);
+	thread_acquire(thread);
+}
+
+static void target_release(loader_t* loader, thread_t* thread) {
+
+	thread_release(thread);
+	loader_release(loader);
+}
+
+static void target_async(loader_t* loader, thread_t* thread, method_t* method, json_node_t* args, json_node_t* answer) {
+
+	job_t* job = job_current;
+
+	// the job answers on completion, the calling thread goes back to serve other requests
+	if (job && !job->deferred) {
+		completion_t* completion = completion_create(NULL, job_complete, job);
+		if (completion) {
+			job->deferred = 1;
+			job->refs ++;
+			// a reload or replaced thread waits for the completion, not only for the call
+			job->loader = loader;
+			job->thread = thread;
+			target_acquire(loader, thread);
+			method->async(thread, args, completion);
+			return;
+		}
+	}
+
+	// batches, datagrams and shared memory answer in place, the call is waited here
+	target_wait_t wait = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0 };
+	completion_t* completion = completion_create(answer, target_wakeup, &wait);
+	if (!completion) {
+		json_node_object_add(answer, "error", json_node_string("out of memory"));
+		return;
+	}
+
+	method->async(thread, args, completion);
+
+	pthread_mutex_lock(&wait.mutex);
+	while (!wait.done)
+		pthread_cond_wait(&wait.cond, &wait.mutex);
+	pthread_mutex_unlock(&wait.mutex);
+
+	pthread_cond_destroy(&wait.cond);
+	pthread_mutex_destroy(&wait.mutex);
+}
+
+// caller holds target_acquire, no read section is held while module code runs
+static void target_call(loader_t* loader, thread_t* thread, method_t* method, json_node_t* args, json_node_t* answer) {
+
+	// module code builds its nodes on heap, one it keeps must not go with the request arena,
+	// nodes it adds to the arena answer are released with it
+	arenas_t* arena = json_node_arena(NULL);
+
+	if (method->async)
+		target_async(loader, thread, method, args, answer);
+
+	else if (method->run)
+		method->run(thread, args, answer);
+
+	json_node_arena(arena);
+}
+
+// caller is inside epochs read section
+static const char* target_lookup(server_t* server, const char* module, const char* thread, const char* method, resolve_t* resolve) {
+
+	if (!(resolve->loader = get_from_rbtree(epochs_load((void**)&server->loader), module)))
+		return "module not found";
+
+	// generation is taken before the pool, a change in between is found on the next call
+	resolve->pool = loader_generation(resolve->loader);
+	if (!(resolve->thread = get_from_loader(resolve->loader, thread)))
+		return "thread not found";
+
+	if (!(resolve->method = loader_method(resolve->loader, method)))
+		return "method not found";
+
+	return NULL;
+}
+
+static void kernel_resolve(connect_t* conn, server_t* server, json_node_t* args, json_node_t* answer) {
+
+	json_node_t* module = json_node_object_node(args, "module", JSON_NODE_TYPE_STRING);
+	json_node_t* thread = json_node_object_node(args, "thread", JSON_NODE_TYPE_STRING);
+	json_node_t* method = json_node_object_node(args, "method", JSON_NODE_TYPE_STRING);
+
+	if (!module || !thread || !method) {
+		json_node_object_add(answer, "error", json_node_string("module, thread and method required"));
+		return;
+	}
+
+	// one connection serves all peers of a datagram socket, a handle would be shared by them
+	if (conn->datagram) {
+		json_node_object_add(answer, "error", json_node_string("resolve needs stream connection"));
+		return;
+	}
+
+	resolve_t resolve;
+	epochs_enter();
+	const char* error = target_lookup(server, json_node_string_value(module), json_node_string_value(thread), json_node_string_value(method), &resolve);
+	epochs_leave();
+
+	if (error) {
+		json_node_object_add(answer, "error", json_node_string(error));
+		return;
+	}
+
+	pthread_mutex_lock(&conn->mutex);
+
+	// the same target keeps its handle, resolving again does not grow the table
+	uint32_t id;
+	for (id = 0; id < conn->handle.count; id ++) {
+		handle_t* handle = &conn->handle.block[id / HANDLE_BLOCK][id % HANDLE_BLOCK];
+		if (!strcmp(handle->module, json_node_string_value(module)) && !strcmp(handle->thread, json_node_string_value(thread)) && !strcmp(handle->method, json_node_string_value(method)))
+			break;
+	}
+
+	if (id == conn->handle.count) {
+		if (id == HANDLE_BLOCK * HANDLE_BLOCKS)
+			error = "too many handles";
+
+		else if (!conn->handle.block[id / HANDLE_BLOCK] && !(conn->handle.block[id / HANDLE_BLOCK] = calloc(HANDLE_BLOCK, sizeof(handle_t))))
+			error = "out of memory";
+
+		else {
+			handle_t* handle = &conn->handle.block[id / HANDLE_BLOCK][id % HANDLE_BLOCK];
+			handle->module = strdup(json_node_string_value(module));
+			handle->thread = strdup(json_node_string_value(thread));
+			handle->method = strdup(json_node_string_value(method));
+
+			if (!handle->module || !handle->thread || !handle->method) {
+				free(handle->module);
+				free(handle->thread);
+				free(handle->method);
+				memset(handle, 0, sizeof(handle_t));
+				error = "out of memory";
+			}
+
+			// requests on other workers see the entry once count covers it
+			else	__atomic_store_n(&conn->handle.count, id + 1, __ATOMIC_RELEASE);
+		}
+	}
+
+	pthread_mutex_unlock(&conn->mutex);
+
+	if (error)
+		json_node_object_add(answer, "error", json_node_string(error));
+	else	json_node_object_add(answer, "handle", json_node_int(id + 1));
+}
+
+static void target_handle(connect_t* conn, server_t* server, int value, json_node_t* args, json_node_t* answer) {
+
+	uint32_t id = value - 1;
+	if (conn->datagram || value < 1 || id >= __atomic_load_n(&conn->handle.count, __ATOMIC_ACQUIRE)) {
+		json_node_object_add(answer, "error", json_node_string("handle not found"));
+		return;
+	}
+
+	handle_t* handle = &conn->handle.block[id / HANDLE_BLOCK][id % HANDLE_BLOCK];
+	resolve_t* replaced = NULL;
+
+	epochs_enter();
+	uint64_t generation = __atomic_load_n(&server->generation, __ATOMIC_ACQUIRE);
+	resolve_t* resolve = __atomic_load_n(&handle->resolve, __ATOMIC_ACQUIRE);
+
+	// registry or thread pool changed since the last call, the names are looked up again
+	if (!resolve || resolve->generation != generation || resolve->pool != loader_generation(resolve->loader)) {
+		resolve_t* update = calloc(1, sizeof(*update));
+		const char* error = "out of memory";
+
+		if (update) {
+			update->generation = generation;
+			error = target_lookup(server, handle->module, handle->thread, handle->method, update);
+		}
+
+		if (error) {
+			json_node_object_add(answer, "error", json_node_string(error));
+			epochs_leave();
+			free(update);
+			return;
+		}
+
+		// a racing caller may still read the replaced record, it is freed after grace without waiting here
+		replaced = __atomic_exchange_n(&handle->resolve, update, __ATOMIC_ACQ_REL);
+		resolve = update;
+	}
+
+	loader_t* loader = resolve->loader;
+	thread_t* thread = resolve->thread;
+	method_t* method = resolve->method;
+	target_acquire(loader, thread);
+	epochs_leave();
+
+	if (replaced)
+		epochs_retire(replaced, free);
+
+	target_call(loader, thread, method, args, answer);
+	target_release(loader, thread);
+}
+
+static void connect_handles(connect_t* conn) {
+
+	uint32_t id;
+	for (id = 0; id < conn->handle.count; id ++) {
+		handle_t* handle = &conn->handle.block[id / HANDLE_BLOCK][id % HANDLE_BLOCK];
+		free(handle->module);
+		free(handle->thread);
+		free(handle->method);
+		free(handle->resolve);
+	}
+
+	for (id = 0; id < HANDLE_BLOCKS; id ++)
+		free(conn->handle.block[id]);
+}
+
+static void kernel_accept(connect_t* conn, server_t* server, json_node_t* args, json_node_t* answer) {
+
+	server_accept_info(server, answer);
+}
+
+static void kernel_admit(connect_t* conn, server_t* server, json_node_t* args, json_node_t* answer) {
+
+	server_admit_info(server, answer);
+}
+
+static const struct {
+	const char* name;
+	const char* description;
+	void (*run)(connect_t* conn, server_t* server, json_node_t* args, json_node_t* answer);
+} kernel_methods[] = {
+	{ "stats",   "server load: connections, requests, modules, workers, admission", kernel_stats },
+	{ "modules", "loaded modules and their thread counts", kernel_modules },
+	{ "accept",  "listener accept counters", kernel_accept },
+	{ "admit",   "admission control gauges and counters", kernel_admit },
+	{ "resolve", "numeric handle of module thread method for this stream connection (args: module, thread, method)", kernel_resolve },
+	{ "reload",  "load new version of module (args: module, file from its directory) keeping threads and properties", kernel_reload },
+	{ "subscribe", "push thread state and property changes to this connection (args: module, thread), frames with id 0", kernel_subscribe },
+	{ "unsubscribe", "stop pushing changes (args: subscription)", kernel_unsubscribe },
+	{ NULL, NULL, NULL },
+};
+
+static void kernel_request(connect_t* conn, server_t* server, json_node_t* method, json_node_t* args, json_node_t* answer) {
+
+	int id;
+
+	if (!method) {
+		json_node_object_add(answer, "info", json_node_string("kernel command"));
+
+		json_node_t* methods = json_node_object(NULL);
+		for (id = 0; kernel_methods[id].name; id ++)
+			json_node_object_add(methods, kernel_methods[id].name, json_node_string(kernel_methods[id].description));
+		json_node_object_add(answer, "method", methods);
+		return;
+	}
+
+	for (id = 0; kernel_methods[id].name; id ++) {
+		if (!strcmp(kernel_methods[id].name, json_node_string_value(method))) {
+			kernel_methods[id].run(conn, server, args, answer);
+			return;
+		}
+	}
+
+	json_node_object_add(answer, "error", json_node_string("method not found"));
+}
+
+void target_request(connect_t* conn, server_t* server, json_node_t* request, json_node_t* answer) {
+
+	if (!conn || !server || !request || !answer)
+		return;
+
+	json_node_t* target = json_node_object_node(request, "target", JSON_NODE_TYPE_OBJECT);
+	json_node_t* args   = json_node_object_node(request, "args"  , JSON_NODE_TYPE_ANY);
+	json_node_t* handle = json_node_object_node(request, "handle", JSON_NODE_TYPE_INTEGER);
+
+	if (handle) {
+		target_handle(conn, server, json_node_int_value(handle), args, answer);
+		return;
+	}
+
+	json_node_t* module = json_node_object_node(target, "module", JSON_NODE_TYPE_STRING);
+	json_node_t* thread = json_node_object_node(target, "thread", JSON_NODE_TYPE_STRING);
+	json_node_t* method = json_node_object_node(target, "method", JSON_NODE_TYPE_STRING);
+
+	if (module) {
+		if (thread) {
+			if (method) {
+				loader_t* target_loader;
+				thread_t* target_thread;
+				method_t* target_method = NULL;
+
+				// only the lookup runs inside the read section, a reload waits for the pinned call
+				epochs_enter();
+				if (!(target_loader = get_from_rbtree(epochs_load((void**)&server->loader), json_node_string_value(module))))
+					json_node_object_add(answer, "error", json_node_string("module not found"));
+
+				else {
+					if (!(target_thread = get_from_loader(target_loader, json_node_string_value(thread))))
+						json_node_object_add(answer, "error", json_node_string("thread not found"));
+
+					else {
+						if (!(target_method = loader_method(target_loader, json_node_string_value(method))))
+							json_node_object_add(answer, "error", json_node_string("method not found"));
+
+						else
+							target_acquire(target_loader, target_thread);
+					}
+				}
+				epochs_leave();
+
+				if (target_method) {
+					target_call(target_loader, target_thread, target_method, args, answer);
+					target_release(target_loader, target_thread);
+				}
+			}
+			else {
+				json_node_object_add(answer, "info", json_node_string("thread command"));
+			}
+		}
+		else {
+			json_node_object_add(answer, "info", json_node_string("module command"));
+		}
+	}
+	else {
+		kernel_request(conn, server, method, args, answer);
+	}
+}
+
+static void batch_release(batch_t* batch) {
+
+	pthread_mutex_lock(&batch->mutex);
+	int refs = -- batch->refs;
+	pthread_mutex_unlock(&batch->mutex);
+
+	if (refs)
+		return;
+
+	pthread_cond_destroy(&batch->cond);
+	pthread_mutex_destroy(&batch->mutex);
+	free(batch->request);
+	free(batch->answer);
+	free(batch);
+}
+
+static void batch_run(batch_t* batch) {
+
+	// arena is not shared between threads, parallel answers are built on heap
+	arenas_t* arena = batch->parallel ? json_node_arena(NULL) : NULL;
+
+	// every runner takes the next request until none left, the batch caller runs too
+	deadline_t* deadline = deadline_enter(batch->deadline);
+	int id, done = 0;
+	while ((id = __sync_fetch_and_add(&batch->next, 1)) < batch->count) {
+		if (deadline_cancelled())
+			json_node_object_add(batch->answer[id], "error", json_node_string("deadline expired"));
+		else	target_request(batch->conn, batch->server, batch->request[id], batch->answer[id]);
+		done ++;
+	}
+	deadline_enter(deadline);
+
+	if (batch->parallel)
+		json_node_arena(arena);
+
+	pthread_mutex_lock(&batch->mutex);
+	batch->done += done;
+	if (batch->done == batch->count)
+		pthread_cond_broadcast(&batch->cond);
+	pthread_mutex_unlock(&batch->mutex);
+
+	batch_release(batch);
+}
+
+static json_node_t* target_batch(connect_t* conn, server_t* server, json_node_t* requests, int parallel) {
+
+	int id, count = json_node_array_count(requests);
+
+	batch_t* batch = calloc(1, sizeof(*batch));
+	json_node_t* answers = json_node_array(NULL);
+	if (!batch || !answers || !(batch->request = calloc(count + 1, sizeof(json_node_t*))) || !(batch->answer = calloc(count + 1, sizeof(json_node_t*)))) {
+		if (batch) {
+			free(batch->request);
+			free(batch);
+		}
+		json_node_destroy(answers);
+		return NULL;
+	}
+
+	batch->conn = conn;
+	batch->server = server;
+	batch->count = count;
+	batch->refs = 1;
+	batch->parallel = parallel && server->worker;
+	// deadline of the caller is taken to runners on other workers
+	batch->deadline = deadline_enter(NULL);
+	deadline_enter(batch->deadline);
+	pthread_mutex_init(&batch->mutex, NULL);
+	pthread_cond_init(&batch->cond, NULL);
+
+	// answers are linked in request order before any of them is filled
+	arenas_t* arena = batch->parallel ? json_node_arena(NULL) : NULL;
+	vector_resize(json_node_array_vector(answers), count);
+	vector_iterator_t* it = vector_iterator_create(json_node_array_vector(requests));
+	for (id = 0; id < count; id ++) {
+		batch->request[id] = vector_iterate(it);
+		batch->answer[id] = json_node_object(NULL);
+	}
+	vector_iterator_destroy(it);
+
+	if (batch->parallel)
+		json_node_arena(arena);
+
+	for (id = 0; id < count; id ++)
+		json_node_array_add(answers, batch->answer[id]);
+
+	int helpers = batch->parallel ? count - 1 : 0;
+	if (helpers > server->workers)
+		helpers = server->workers;
+
+	// helpers are only queued when a worker is free to take them, the caller never blocks on the pool
+	while (helpers --) {
+		pthread_mutex_lock(&batch->mutex);
+		batch->refs ++;
+		pthread_mutex_unlock(&batch->mutex);
+
+		if (worker_try(server->worker, (void(*)(void*)) batch_run, batch)) {
+			batch_release(batch);
+			break;
+		}
+	}
+
+	pthread_mutex_lock(&batch->mutex);
+	batch->refs ++;
+	pthread_mutex_unlock(&batch->mutex);
+	batch_run(batch);
+
+	pthread_mutex_lock(&batch->mutex);
+	while (batch->done < batch->count)
+		pthread_cond_wait(&batch->cond, &batch->mutex);
+	pthread_mutex_unlock(&batch->mutex);
+
+	batch_release(batch);
+	return answers;
+}
+
+static json_node_t* target_deadline(connect_t* conn, server_t* server, json_node_t* request) {
+
+	// work nobody waits for any more is not dispatched
+	if (deadline_cancelled()) {
+		__sync_fetch_and_add(&server->stat.expired, 1);
+		json_node_t* answer = json_node_object(NULL);
+		json_node_object_add(answer, "error", json_node_string(conn->closed ? "client gone" : "deadline expired"));
+		return answer;
+	}
+
+	json_node_t* batch = NULL;
+	int parallel = 0;
+
+	// a batch is an array of requests or {"batch":[requests],"parallel":true}
+	if (json_node_type(request) == JSON_NODE_TYPE_ARRAY)
+		batch = request;
+
+	else if ((batch = json_node_object_node(request, "batch", JSON_NODE_TYPE_ARRAY)))
+		parallel = json_node_bool_value(json_node_object_node(request, "parallel", JSON_NODE_TYPE_BOOL));
+
+	json_node_t* answer = NULL;
+	if (batch) {
+		// batch items answer in place, so async items are not deferred
+		job_t* job = job_current;
+		job_current = NULL;
+		answer = target_batch(conn, server, batch, parallel);
+		job_current = job;
+
+		if (answer)
+			return answer;
+	}
+
+	answer = json_node_object(NULL);
+	if (batch)
+		json_node_object_add(answer, "error", json_node_string("batch failed"));
+	else	target_request(conn, server, request, answer);
+	return answer;
+}
+
+// deadline->at is when the request was readed, request "deadline" milliseconds are counted from it
+json_node_t* target_answer(connect_t* conn, server_t* server, json_node_t* request, deadline_t* deadline) {
+
+	json_node_t* budget = json_node_object_node(request, "deadline", JSON_NODE_TYPE_INTEGER);
+	if (deadline && budget) {
+		long ms = json_node_int_value(budget);
+		if (ms < 0)
+			ms = 0;
+		deadline->at.tv_sec += ms / 1000;
+		deadline->at.tv_nsec += (ms % 1000) * 1000000L;
+		if (deadline->at.tv_nsec >= 1000000000L) {
+			deadline->at.tv_sec ++;
+			deadline->at.tv_nsec -= 1000000000L;
+		}
+		deadline->set = 1;
+	}
+
+	// stop waits for calls counted here, one that checks after stopping was set is refused
+	__atomic_add_fetch(&server->stat.running, 1, __ATOMIC_SEQ_CST);
+
+	json_node_t* answer;
+	if (server_stopping(server)) {
+		answer = json_node_object(NULL);
+		json_node_object_add(answer, "error", json_node_string("server stopping"));
+	}
+
+	else {
+		deadline_t* outer = deadline_enter(deadline);
+		answer = target_deadline(conn, server, request);
+		deadline_enter(outer);
+	}
+
+	__atomic_sub_fetch(&server->stat.running, 1, __ATOMIC_SEQ_CST);
+	return answer;
+}
+
+static void connect_link(connect_t* conn) {
+
+	server_t* server = conn->server;
+
+	pthread_mutex_lock(&server->open.mutex);
+	conn->link.prev = NULL;
+	conn->link.next = server->open.head;
+	if (server->open.head)
+		server->open.head->link.prev = conn;
+	server->open.head = conn;
+	pthread_mutex_unlock(&server->open.mutex);
+}
+
+static void connect_unlink(connect_t* conn) {
+
+	server_t* server = conn->server;
+
+	pthread_mutex_lock(&server->open.mutex);
+	if (conn->link.prev)
+		conn->link.prev->link.next = conn->link.next;
+	else	server->open.head = conn->link.next;
+	if (conn->link.next)
+		conn->link.next->link.prev = conn->link.prev;
+	pthread_mutex_unlock(&server->open.mutex);
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+static void answer_destroy(connect_t* conn, answer_t* answer);
+#endif
+
+static void connect_release(connect_t* conn) {
+
+	pthread_mutex_lock(&conn->mutex);
+	int refs = -- conn->refs;
+	pthread_mutex_unlock(&conn->mutex);
+
+	if (refs)
+		return;
+
+	DEBUG("client %d disconnected", conn->stat.count);
+
+	server_t* server = conn->server;
+	connect_unlink(conn);
+
+	if (__atomic_load_n(&conn->subscribed, __ATOMIC_SEQ_CST))
+		connect_unsubscribe(conn);
+
+	connect_handles(conn);
+	parser_destroy(conn->parser);
+	framer_destroy(conn->framer);
+	shmrng_destroy(conn->shm);
+
+#ifdef HAVE_SYS_EPOLL_H
+	while (conn->out.head) {
+		answer_t* answer = conn->out.head;
+		conn->out.head = answer->next;
+		answer_destroy(conn, answer);
+	}
+#endif
+
+	arenas_destroy(conn->arena);
+	close(conn->sock);
+	free(conn->in.buffer);
+	free(conn->out.buffer);
+
+	while (conn->uring.head) {
+		send_t* send = conn->uring.head;
+		conn->uring.head = send->next;
+		free(send->buffer);
+		free(send);
+	}
+
+	while (conn->event.head) {
+		event_t* event = conn->event.head;
+		conn->event.head = event->next;
+		free(event);
+	}
+
+	// wake pipe of connection thread, pushes stop with the subscriptions above
+	if (conn->framer && !conn->reactor) {
+		close(conn->event.wake[0]);
+		close(conn->event.wake[1]);
+	}
+
+	pthread_cond_destroy(&conn->cond);
+	pthread_mutex_destroy(&conn->event.mutex);
+	pthread_mutex_destroy(&conn->mutex);
+	free(conn);
+
+	// stop waits for this count, server state is not touched after it
+	__sync_sub_and_fetch(&server->stat.connections, 1);
+}
+
+// bounded queue of pushed events, 1 when the io context needs a wakeup, -1 when the event is dropped
+static int connect_queue(connect_t* conn, const char* body, uint32_t size) {
+
+	event_t* event = NULL;
+	int res = -1;
+
+	pthread_mutex_lock(&conn->event.mutex);
+	if (conn->event.count < EVENT_QUEUE_DEPTH && (event = malloc(sizeof(*event) + size))) {
+		event->next = NULL;
+		event->size = size;
+		memcpy(event->body, body, size);
+
+		if (conn->event.tail)
+			conn->event.tail->next = event;
+		else	conn->event.head = event;
+		conn->event.tail = event;
+		res = !conn->event.count ++;
+	}
+	pthread_mutex_unlock(&conn->event.mutex);
+
+	return res;
+}
+
+static int connect_pending(connect_t* conn) {
+
+	pthread_mutex_lock(&conn->event.mutex);
+	int count = conn->event.count;
+	pthread_mutex_unlock(&conn->event.mutex);
+	return count;
+}
+
+// take queued events, the caller sends and frees them
+static event_t* connect_events(connect_t* conn) {
+
+	pthread_mutex_lock(&conn->event.mutex);
+	event_t* event = conn->event.head;
+	conn->event.head = conn->event.tail = NULL;
+	conn->event.count = 0;
+	pthread_mutex_unlock(&conn->event.mutex);
+	return event;
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+static int connect_arm(connect_t* conn, int events) {
+
+	if (conn->events == events)
+		return 0;
+
+	struct epoll_event event = { .events = events, .data.ptr = conn };
+	conn->events = events;
+	return epoll_ctl(conn->reactor->epfd, EPOLL_CTL_MOD, conn->sock, &event);
+}
+
+// call with conn->mutex locked
+static int connect_flush(connect_t* conn) {
+
+	while (conn->out.writed != conn->out.size) {
+		int msgsize = write(conn->sock, &conn->out.buffer[conn->out.writed], conn->out.size - conn->out.writed);
+		if (msgsize < 0) {
+			if (errno == EINTR)
+				continue;
+
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				return -1;
+
+			return connect_arm(conn, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET);
+		}
+
+		conn->out.writed += msgsize;
+	}
+
+	if (conn->out.buffer) {
+		free(conn->out.buffer);
+		conn->out.buffer = NULL;
+		conn->out.size = conn->out.writed = 0;
+	}
+
+	// queued events are sent by the reactor once answers are out
+	return connect_arm(conn, EPOLLIN | (connect_pending(conn) ? EPOLLOUT : 0) | EPOLLRDHUP | EPOLLET);
+}
+#endif
+
+#ifdef ENABLE_URING
+static void uring_kick(connect_t* conn);
+
+// call with conn->mutex locked, buffer is owned by the send when queued
+static int uring_queue(connect_t* conn, char* buffer, uint32_t size) {
+
+	send_t* send = calloc(1, sizeof(*send));
+	if (!send)
+		return -1;
+
+	send->conn = conn;
+	send->buffer = buffer;
+	send->size = size;
+
+	if (conn->uring.tail)
+		conn->uring.tail->next = send;
+	else	conn->uring.head = send;
+	conn->uring.tail = send;
+
+	// queued bytes hold frames without request id like the epoll out buffer
+	conn->out.size += send->size;
+	return 0;
+}
+#endif
+
+static int frame_append(char** out, uint32_t* size, uint32_t flags, uint32_t id, const char* buffer, uint32_t len) {
+
+	uint32_t header[2] = { len | flags, id };
+	uint32_t hsize = HEADER_MSG_SIZE + ((flags & FRAME_FLAG_ID) ? FRAME_ID_SIZE : 0);
+
+	char* data = realloc(*out, *size + hsize + len);
+	if (!data)
+		return -1;
+
+	memcpy(&data[*size], header, hsize);
+	memcpy(&data[*size + hsize], buffer, len);
+	*out = data;
+	*size += hsize + len;
+	return 0;
+}
+
+// frame taken events as pushes into one buffer, events are freed
+static char* event_frames(event_t* event, uint32_t* size) {
+
+	char* out = NULL;
+	*size = 0;
+
+	while (event) {
+		event_t* next = event->next;
+		if (frame_append(&out, size, FRAME_FLAG_ID, FRAME_PUSH_ID, event->body, event->size))
+			WARN("event of %u bytes dropped", event->size);
+		free(event);
+		event = next;
+	}
+
+	return out;
+}
+
+// frames of one message are never interleaved with other frames, the lock is not held while writing
+static void connect_claim(connect_t* conn) {
+
+	pthread_mutex_lock(&conn->mutex);
+	while (conn->out.streaming)
+		pthread_cond_wait(&conn->cond, &conn->mutex);
+	conn->out.streaming = 1;
+	pthread_mutex_unlock(&conn->mutex);
+}
+
+static void connect_yield(connect_t* conn) {
+
+	pthread_mutex_lock(&conn->mutex);
+	conn->out.streaming = 0;
+	pthread_cond_broadcast(&conn->cond);
+	pthread_mutex_unlock(&conn->mutex);
+}
+
+// thread and shm connections send queued events from their own thread
+static int connect_deliver(connect_t* conn) {
+
+	event_t* event = connect_events(conn);
+	int res = 0;
+
+	if (!event)
+		return 0;
+
+	// events go between answers, not between chunks of one
+	connect_claim(conn);
+
+	while (event) {
+		event_t* next = event->next;
+		if (!res) {
+			if (conn->shm)
+				res = shmrng_write(conn->shm, FRAME_FLAG_ID, FRAME_PUSH_ID, event->body, event->size);
+			else	res = framer_write(conn->framer, FRAME_FLAG_ID, FRAME_PUSH_ID, event->body, event->size);
+		}
+		free(event);
+		event = next;
+	}
+
+	connect_yield(conn);
+	return res;
+}
+
+static int stream_chunk(stream_t* stream, uint32_t more) {
+
+	connect_t* conn = stream->conn;
+	uint32_t flags = stream->flags | more;
+
+	int res = 0;
+#ifdef HAVE_SYS_EPOLL_H
+	if (conn->reactor)
+		res = frame_append(&stream->out, &stream->size, flags, stream->id, stream->chunk, stream->used);
+
+	else
+#endif
+	if (conn->shm)
+		res = shmrng_write(conn->shm, flags, stream->id, stream->chunk, stream->used);
+
+	else	res = framer_write(conn->framer, flags, stream->id, stream->chunk, stream->used);
+
+	stream->used = 0;
+	return res;
+}
+
+static int stream_write(void* data, const char* str, int len) {
+
+	stream_t* stream = data;
+	if ((stream->total += len) > IO_MESSAGE_SIZE)
+		return -1;
+
+	while (len) {
+		// the last chunk is sent by connect_answer without FRAME_FLAG_MORE
+		if (stream->used == IO_BUFFER_SIZE && stream_chunk(stream, FRAME_FLAG_MORE))
+			return -1;
+
+		int part = IO_BUFFER_SIZE - stream->used;
+		if (part > len)
+			part = len;
+
+		memcpy(&stream->chunk[stream->used], str, part);
+		stream->used += part;
+		str += part;
+		len -= part;
+	}
+
+	return 0;
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+// call with conn->mutex locked, the arena goes back to the connection cache
+static void answer_destroy(connect_t* conn, answer_t* answer) {
+
+	json_cursor_destroy(answer->cursor);
+	json_node_destroy(answer->node);
+
+	if (answer->arena) {
+		arenas_reset(answer->arena);
+		if (!conn->arena) {
+			conn->arena = answer->arena;
+			answer->arena = NULL;
+		}
+		arenas_destroy(answer->arena);
+	}
+
+	free(answer->out);
+	free(answer);
+}
+
+// call with conn->mutex locked, next frames of the first queued answer, it is dropped once printed whole
+static int answer_print(connect_t* conn, char** out, uint32_t* size) {
+
+	answer_t* answer = conn->out.head;
+	int res = 0;
+
+	if (!answer->cursor) {
+		*out = answer->out;
+		*size = answer->size;
+		answer->out = NULL;
+	}
+
+	else {
+		stream_t stream;
+		stream.conn = conn;
+		stream.flags = answer->flags;
+		stream.id = answer->id;
+		stream.used = stream.size = 0;
+		stream.total = answer->total;
+		stream.out = NULL;
+
+		// a cursor left in the middle has at least a closing bracket to print
+		res = json_cursor_write(answer->cursor, STREAM_BUDGET, stream_write, &stream);
+		if (res >= 0 && stream.used && stream_chunk(&stream, res ? FRAME_FLAG_MORE : 0))
+			res = -1;
+
+		answer->total = stream.total;
+		*out = stream.out;
+		*size = stream.size;
+
+		if (res < 0) {
+			ERROR("client %d answer failed after %u bytes", conn->stat.count, stream.total);
+			free(stream.out);
+			*out = NULL;
+			*size = 0;
+			return -1;
+		}
+	}
+
+	if (!res) {
+		if (!(conn->out.head = answer->next))
+			conn->out.tail = NULL;
+		answer_destroy(conn, answer);
+	}
+
+	return 0;
+}
+
+// call with conn->mutex locked, answers are printed while the socket takes them, EPOLLOUT resumes the rest
+static int connect_pump(connect_t* conn) {
+
+	int res;
+	while (!(res = connect_flush(conn)) && !conn->out.buffer && conn->out.head) {
+		if (answer_print(conn, &conn->out.buffer, &conn->out.size))
+			return -1;
+	}
+
+	return res;
+}
+
+#ifdef ENABLE_URING
+// call with conn->mutex locked, small answers go together, a long one a chunk per send completion
+static int uring_pump(connect_t* conn) {
+
+	while (conn->out.head && conn->out.size < STREAM_BUDGET) {
+		char* out = NULL;
+		uint32_t size = 0;
+		if (answer_print(conn, &out, &size))
+			return -1;
+
+		if (out && uring_queue(conn, out, size)) {
+			free(out);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+#endif
+
+// answers keep their order, what the socket does not take now is sent by the reactor
+static void connect_push(connect_t* conn, answer_t* answer) {
+
+	pthread_mutex_lock(&conn->mutex);
+	if (conn->out.tail)
+		conn->out.tail->next = answer;
+	else	conn->out.head = answer;
+	conn->out.tail = answer;
+
+	int res = conn->reactor->uring ? 0 : connect_pump(conn);
+	pthread_mutex_unlock(&conn->mutex);
+
+#ifdef ENABLE_URING
+	// sends are submitted by the reactor thread owning the ring
+	if (conn->reactor->uring)
+		uring_kick(conn);
+#endif
+
+	if (res)
+		shutdown(conn->sock, SHUT_RDWR);
+}
+#endif
+
+static void connect_answer(connect_t* conn, uint32_t flags, uint32_t id, json_node_t* answer) {
+
+	stream_t stream;
+	stream.conn = conn;
+	stream.flags = flags;
+	stream.id = id;
+	stream.used = stream.total = stream.size = 0;
+	stream.out = NULL;
+
+	int res = 0;
+#ifdef HAVE_SYS_EPOLL_H
+	if (conn->reactor) {
+		// the caller keeps the tree, it is printed whole without the lock and queued
+		answer_t* queued = calloc(1, sizeof(*queued));
+		if (!queued || json_node_write(answer, JSON_STYLE_MINIMAL, stream_write, &stream) || stream_chunk(&stream, 0))
+			res = -1;
+
+		else {
+			queued->out = stream.out;
+			queued->size = stream.size;
+			connect_push(conn, queued);
+			return;
+		}
+
+		free(stream.out);
+		free(queued);
+	}
+
+	else
+#endif
+	{
+		// chunks of one answer are not interleaved with other frames, pushed events and answers go between them
+		connect_claim(conn);
+		if (json_node_write(answer, JSON_STYLE_MINIMAL, stream_write, &stream) || stream_chunk(&stream, 0))
+			res = -1;
+		connect_yield(conn);
+	}
+
+	if (res) {
+		ERROR("client %d answer failed after %u bytes", conn->stat.count, stream.total);
+		shutdown(conn->sock, SHUT_RDWR);
+	}
+}
+
+static void connect_kick(connect_t* conn, int busy) {
+
+	pthread_mutex_lock(&conn->mutex);
+	conn->busy -= busy;
+	pthread_cond_broadcast(&conn->cond);
+#ifdef HAVE_SYS_EPOLL_H
+	// wake reactor to read frames held while a job was running or admission was full
+	if (conn->reactor && !conn->reactor->uring)
+		connect_arm(conn, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET);
+#endif
+	pthread_mutex_unlock(&conn->mutex);
+
+#ifdef ENABLE_URING
+	if (conn->reactor && conn->reactor->uring)
+		uring_kick(conn);
+#endif
+}
+
+// connection and in flight request limits, 0 is unlimited
+static int server_admit_connect(server_t* server) {
+
+	int connections = __sync_add_and_fetch(&server->stat.connections, 1);
+	if (!server->admit.connections || connections <= server->admit.connections)
+		return 0;
+
+	__sync_sub_and_fetch(&server->stat.connections, 1);
+	__sync_fetch_and_add(&server->admit.refused, 1);
+	return -1;
+}
+
+static int connect_room(connect_t* conn) {
+
+	server_t* server = conn->server;
+	if (server->admit.conn && conn->busy >= server->admit.conn)
+		return 0;
+
+	if (!server->admit.flight || server->stat.flight < server->admit.flight)
+		return !0;
+
+	if (!server->admit.pause)
+		return 0;
+
+	// paused connection is kicked when a global slot is freed, called with conn mutex locked
+	if (!conn->admit.paused) {
+		conn->admit.paused = 1;
+		conn->refs ++;
+		pthread_mutex_lock(&server->admit.mutex);
+		conn->admit.next = server->admit.paused;
+		server->admit.paused = conn;
+		server->admit.pauses ++;
+		pthread_mutex_unlock(&server->admit.mutex);
+	}
+
+	// slot freed before the connection was listed would not kick it
+	__sync_synchronize();
+	return server->stat.flight < server->admit.flight;
+}
+
+static int connect_admit(connect_t* conn) {
+
+	server_t* server = conn->server;
+	if (server->admit.conn && conn->busy >= server->admit.conn)
+		return 0;
+
+	int flight = __sync_add_and_fetch(&server->stat.flight, 1);
+	if (server->admit.flight && flight > server->admit.flight) {
+		__sync_sub_and_fetch(&server->stat.flight, 1);
+		return 0;
+	}
+
+	return !0;
+}
+
+static void server_resume(server_t* server) {
+
+	pthread_mutex_lock(&server->admit.mutex);
+	connect_t* conn = server->admit.paused;
+	server->admit.paused = NULL;
+	pthread_mutex_unlock(&server->admit.mutex);
+
+	while (conn) {
+		connect_t* next = conn->admit.next;
+
+		pthread_mutex_lock(&conn->mutex);
+		conn->admit.paused = 0;
+		pthread_mutex_unlock(&conn->mutex);
+
+		connect_kick(conn, 0);
+		connect_release(conn);
+		conn = next;
+	}
+}
+
+static void server_admit_info(server_t* server, json_node_t* info) {
+
+	// counters are bumped by other threads, each one is read once
+	uint64_t admitted = __atomic_load_n(&server->admit.admitted, __ATOMIC_RELAXED);
+	uint64_t delay = __atomic_load_n(&server->admit.delay_total, __ATOMIC_RELAXED);
+
+	json_node_object_add(info, "connections", json_node_int(__atomic_load_n(&server->stat.connections, __ATOMIC_RELAXED)));
+	json_node_object_add(info, "connections_limit", json_node_int(server->admit.connections));
+	json_node_object_add(info, "flight", json_node_int(__atomic_load_n(&server->stat.flight, __ATOMIC_RELAXED)));
+	json_node_object_add(info, "flight_limit", json_node_int(server->admit.flight));
+	json_node_object_add(info, "conn_flight_limit", json_node_int(server->admit.conn));
+	json_node_object_add(info, "pause", json_node_bool(server->admit.pause));
+	json_node_object_add(info, "refused", json_node_long(__atomic_load_n(&server->admit.refused, __ATOMIC_RELAXED)));
+	json_node_object_add(info, "rejected", json_node_long(__atomic_load_n(&server->admit.rejected, __ATOMIC_RELAXED)));
+	json_node_object_add(info, "pauses", json_node_long(__atomic_load_n(&server->admit.pauses, __ATOMIC_RELAXED)));
+	json_node_object_add(info, "admitted", json_node_long(admitted));
+	json_node_object_add(info, "delay_avg_us", json_node_double(admitted ? (double)delay / admitted : 0));
+	json_node_object_add(info, "delay_max_us", json_node_long(__atomic_load_n(&server->admit.delay_max, __ATOMIC_RELAXED)));
+}
+
+static void connect_done(connect_t* conn, int kick) {
+
+	server_t* server = conn->server;
+	__sync_sub_and_fetch(&server->stat.flight, 1);
+
+	if (kick)
+		connect_kick(conn, 1);
+	else {
+		pthread_mutex_lock(&conn->mutex);
+		conn->busy --;
+		pthread_cond_broadcast(&conn->cond);
+		pthread_mutex_unlock(&conn->mutex);
+	}
+
+	if (server->admit.paused)
+		server_resume(server);
+
+	connect_release(conn);
+}
+
+static void connect_wait(connect_t* conn) {
+
+	pthread_mutex_lock(&conn->mutex);
+	while (conn->busy)
+		pthread_cond_wait(&conn->cond, &conn->mutex);
+	pthread_mutex_unlock(&conn->mutex);
+}
+
+static void connect_hold(connect_t* conn) {
+
+	// next frame is not readed while admission is full
+	pthread_mutex_lock(&conn->mutex);
+	while (!connect_room(conn))
+		pthread_cond_wait(&conn->cond, &conn->mutex);
+	pthread_mutex_unlock(&conn->mutex);
+}
+
+// requests in flight on one connection take arenas from its cache of one
+static arenas_t* connect_arena(connect_t* conn) {
+
+	pthread_mutex_lock(&conn->mutex);
+	arenas_t* arena = conn->arena;
+	conn->arena = NULL;
+	pthread_mutex_unlock(&conn->mutex);
+
+	return arena ? arena : arenas_create(ARENA_SIZE);
+}
+
+static void connect_recycle(connect_t* conn, arenas_t* arena) {
+
+	arenas_reset(arena);
+
+	pthread_mutex_lock(&conn->mutex);
+	if (!conn->arena) {
+		conn->arena = arena;
+		arena = NULL;
+	}
+	pthread_mutex_unlock(&conn->mutex);
+
+	arenas_destroy(arena);
+}
+
+// answer tree and its arena are taken, a reactor connection prints it as the socket drains
+static void connect_stream(connect_t* conn, uint32_t flags, uint32_t id, json_node_t* answer, arenas_t* arena) {
+
+#ifdef HAVE_SYS_EPOLL_H
+	answer_t* queued = conn->reactor ? calloc(1, sizeof(*queued)) : NULL;
+	if (queued && (queued->cursor = json_cursor_create(answer, JSON_STYLE_MINIMAL))) {
+		queued->flags = flags;
+		queued->id = id;
+		queued->node = answer;
+		queued->arena = arena;
+		connect_push(conn, queued);
+		return;
+	}
+	free(queued);
+#endif
+
+	connect_answer(conn, flags, id, answer);
+	json_node_destroy(answer);
+	if (arena)
+		connect_recycle(conn, arena);
+}
+
+static void job_release(job_t* job) {
+
+	if (__sync_sub_and_fetch(&job->refs, 1))
+		return;
+
+	// the reactor does not wait for a deferred answer, it is woken like for a worker job
+	connect_done(job->conn, job->kick || job->deferred);
+	free(job);
+}
+
+static void job_run(job_t* job) {
+
+	connect_t* conn = job->conn;
+	server_t* server = conn->server;
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	uint64_t delay = (now.tv_sec - job->queued.tv_sec) * 1000000LL + (now.tv_nsec - job->queued.tv_nsec) / 1000;
+	__sync_fetch_and_add(&server->admit.admitted, 1);
+	__sync_fetch_and_add(&server->admit.delay_total, delay);
+
+	uint64_t max = server->admit.delay_max;
+	while (delay > max && !__sync_bool_compare_and_swap(&server->admit.delay_max, max, delay))
+		max = server->admit.delay_max;
+
+	// request and answer trees live in the job arena, teardown is one reset
+	arenas_t* arena = json_node_arena(job->arena);
+	job_current = job;
+	json_node_t* answer = target_answer(conn, conn->server, job->request, &job->deadline);
+	job_current = NULL;
+	json_node_destroy(job->request);
+	json_node_arena(arena);
+
+	if (!job->deferred)
+		connect_stream(conn, job->flags, job->id, answer, job->arena);
+
+	else {
+		json_node_destroy(answer);
+		if (job->arena)
+			connect_recycle(conn, job->arena);
+	}
+
+	job_release(job);
+}
+
+static void job_complete(void* data, json_node_t* answer) {
+
+	job_t* job = data;
+	connect_answer(job->conn, job->flags, job->id, answer);
+	target_release(job->loader, job->thread);
+	job_release(job);
+}
+
+static void connect_overloaded(connect_t* conn, uint32_t flags, uint32_t id) {
+
+	__sync_fetch_and_add(&conn->server->admit.rejected, 1);
+
+	json_node_t* answer = json_node_object(NULL);
+	json_node_object_add(answer, "error", json_node_string("overloaded"));
+	connect_answer(conn, flags & FRAME_FLAG_ID, id, answer);
+	json_node_destroy(answer);
+}
+
+static int connect_dispatch(connect_t* conn, uint32_t flags, uint32_t id, const char* buffer, uint32_t size) {
+
+	conn->stat.reqst ++;
+	__sync_fetch_and_add(&conn->server->stat.reqst, 1);
+
+	pthread_mutex_lock(&conn->mutex);
+	int admit = connect_admit(conn);
+	if (admit) {
+		conn->busy ++;
+		conn->refs ++;
+	}
+	pthread_mutex_unlock(&conn->mutex);
+
+	// over limit request is answered at once without parsing
+	if (!admit) {
+		connect_overloaded(conn, flags, id);
+		return 0;
+	}
+
+	job_t* job = malloc(sizeof(*job));
+	if (!job) {
+		connect_done(conn, 0);
+		return -1;
+	}
+
+	job->conn = conn;
+	job->flags = flags & FRAME_FLAG_ID;
+	job->id = id;
+	job->arena = connect_arena(conn);
+	job->deferred = 0;
+	job->refs = 1;
+	job->loader = NULL;
+	job->thread = NULL;
+
+	arenas_t* arena = json_node_arena(job->arena);
+	job->request = parser_parse_buffer(conn->parser, buffer, size);
+	json_node_arena(arena);
+	// worker pool is destroyed after stop drains requests admitted before it
+	job->kick = conn->server->worker != NULL && !server_stopping(conn->server);
+	clock_gettime(CLOCK_MONOTONIC, &job->queued);
+	job->deadline.at = job->queued;
+	job->deadline.set = 0;
+	job->deadline.cancel = &conn->closed;
+
+	if (!job->kick || worker_push(conn->server->worker, (void(*)(void*)) job_run, job)) {
+		job->kick = 0;
+		job_run(job);
+	}
+
+	return 0;
+}
+
+// answers and pushes keep a connection thread open while its client is quiet
+static int connect_waiting(connect_t* conn) {
+
+	pthread_mutex_lock(&conn->mutex);
+	int busy = conn->busy;
+	pthread_mutex_unlock(&conn->mutex);
+
+	return busy || __atomic_load_n(&conn->subscribed, __ATOMIC_SEQ_CST);
+}
+
+void connect_thread(connect_t* conn) {
+
+	if (!(conn->framer = framer_create(conn->sock))) {
+		connect_release(conn);
+		return;
+	}
+
+	// pushed events wake the thread beside the socket
+	if (pipe2(conn->event.wake, O_CLOEXEC | O_NONBLOCK)) {
+		conn->event.wake[0] = conn->event.wake[1] = -1;
+		connect_release(conn);
+		return;
+	}
+
+	DEBUG("client %d connected", conn->stat.count);
+
+	char* buffer = NULL;
+	uint32_t used = 0;
+
+	struct pollfd fds[2] = { { .fd = conn->sock, .events = POLLIN }, { .fd = conn->event.wake[0], .events = POLLIN } };
+
+	while (1) {
+		uint32_t flags, id, size;
+		const char* data;
+
+		int res;
+		while (!(res = framer_frame(conn->framer, &flags, &id, &data, &size))) {
+			// poll timeout is the idle timer of a connection thread
+			int ready = poll(fds, 2, conn->server->idle ? conn->server->idle * 1000 : -1);
+			if (ready < 0 && errno == EINTR)
+				continue;
+
+			if (ready < 0)
+				break;
+
+			if (fds[1].revents) {
+				char drain[64];
+				while (read(conn->event.wake[0], drain, sizeof(drain)) > 0);
+				if (connect_deliver(conn))
+					break;
+			}
+
+			if (fds[0].revents) {
+				int msgsize = framer_fill(conn->framer);
+				if (msgsize <= 0 && !(msgsize < 0 && errno == EINTR))
+					break;
+			}
+
+			if (ready || connect_waiting(conn))
+				continue;
+
+			DEBUG("client %d idle for %d s, closed", conn->stat.count, conn->server->idle);
+			__sync_fetch_and_add(&conn->server->stat.reaped, 1);
+			break;
+		}
+
+		if (res <= 0)
+			break;
+
+		framer_drop(conn->framer);
+
+		// chunks are collected until the whole message is readed
+		if ((flags & FRAME_FLAG_MORE) || used) {
+			if (used + size > IO_MESSAGE_SIZE)
+				break;
+
+			char* message = realloc(buffer, used + size + 1);
+			if (!message)
+				break;
+
+			buffer = message;
+			memcpy(&buffer[used], data, size);
+			used += size;
+
+			if (flags & FRAME_FLAG_MORE)
+				continue;
+
+			data = buffer;
+			size = used;
+			used = 0;
+		}
+
+		// frames without request id are answered in request order
+		if (!(flags & FRAME_FLAG_ID))
+			connect_wait(conn);
+
+		if (conn->server->admit.pause)
+			connect_hold(conn);
+
+		if (connect_dispatch(conn, flags, id, data, size))
+			break;
+	}
+
+	free(buffer);
+	conn->closed = 1;
+	connect_wait(conn);
+	connect_release(conn);
+}
+
+// accept rate is counted per monotonic second, a second without accepts reads as zero
+static void shard_second(shard_t* shard, time_t now) {
+
+	if (now == shard->stat.second)
+		return;
+
+	shard->stat.rate = (now == shard->stat.second + 1) ? shard->stat.current : 0;
+	if (shard->stat.rate > shard->stat.rate_max)
+		shard->stat.rate_max = shard->stat.rate;
+
+	shard->stat.current = 0;
+	shard->stat.second = now;
+}
+
+static void shard_count(shard_t* shard, int sock) {
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	pthread_mutex_lock(&shard->mutex);
+	shard_second(shard, now.tv_sec);
+	if (sock == -1)
+		shard->stat.failed ++;
+	else {
+		shard->stat.accepted ++;
+		shard->stat.current ++;
+	}
+	pthread_mutex_unlock(&shard->mutex);
+}
+
+static int shard_accept(shard_t* shard, struct sockaddr_in* client) {
+
+	int sock;
+	socklen_t optlen = sizeof(*client);
+	while ((sock = accept4(shard->sock, (struct sockaddr*)client, &optlen, SOCK_CLOEXEC)) == -1 && errno == EINTR);
+
+	// nonblocking listener tells with EAGAIN that the backlog is drained, stop shuts it down
+	if (sock == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || server_stopping(shard->server)))
+		return -1;
+
+	if (sock == -1)
+		WARN("accept: %s", strerror(errno));
+
+	shard_count(shard, sock);
+	return sock;
+}
+
+static void shard_wakeup(shard_t* shard, int burst) {
+
+	pthread_mutex_lock(&shard->mutex);
+	shard->stat.wakeups ++;
+	if (burst > shard->stat.burst_max)
+		shard->stat.burst_max = burst;
+	pthread_mutex_unlock(&shard->mutex);
+}
+
+static void server_accept_info(server_t* server, json_node_t* info) {
+
+	uint64_t accepted = 0, failed = 0, wakeups = 0;
+	int rate = 0, rate_max = 0, burst_max = 0, id;
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	for (id = 0; id < server->shards; id ++) {
+		shard_t* shard = &server->shard[id];
+		pthread_mutex_lock(&shard->mutex);
+		shard_second(shard, now.tv_sec);
+		accepted += shard->stat.accepted;
+		failed += shard->stat.failed;
+		wakeups += shard->stat.wakeups;
+		rate += shard->stat.rate;
+		rate_max += shard->stat.current > shard->stat.rate_max ? shard->stat.current : shard->stat.rate_max;
+		if (shard->stat.burst_max > burst_max)
+			burst_max = shard->stat.burst_max;
+		pthread_mutex_unlock(&shard->mutex);
+	}
+
+	json_node_object_add(info, "accepted", json_node_long(accepted));
+	json_node_object_add(info, "failed", json_node_long(failed));
+	json_node_object_add(info, "wakeups", json_node_long(wakeups));
+	json_node_object_add(info, "burst_max", json_node_int(burst_max));
+	json_node_object_add(info, "rate", json_node_int(rate));
+	json_node_object_add(info, "rate_max", json_node_int(rate_max));
+}
+
+static void connect_spawn(server_t* server, shard_t* shard, int sock, struct sockaddr_in* client) {
+
+	if (server_admit_connect(server)) {
+		close(sock);
+		return;
+	}
+
+	// connection state is owned by its thread, the listener does not wait for it
+	connect_t* conn = calloc(1, sizeof(*conn));
+	if (!conn) {
+		__sync_sub_and_fetch(&server->stat.connections, 1);
+		close(sock);
+		return;
+	}
+
+	int optarg = 1;
+	setsockopt (sock, SOL_SOCKET, SO_KEEPALIVE, &optarg, sizeof(optarg));
+
+	pthread_mutex_init(&conn->mutex, NULL);
+	pthread_mutex_init(&conn->event.mutex, NULL);
+	pthread_cond_init(&conn->cond, NULL);
+	conn->refs = 1;
+	conn->sock = sock;
+	conn->client = *client;
+	conn->server = server;
+	conn->shard = shard;
+	conn->parser = parser_create();
+	conn->stat.count = __sync_fetch_and_add(&server->stat.count, 1);
+	connect_link(conn);
+
+	pthread_t td;
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED);
+	if (!conn->parser || pthread_create(&td, &attr, (void*(*)(void*)) connect_thread, conn)) {
+		ERROR("pthread_create: %s", strerror(errno));
+		connect_release(conn);
+	}
+	pthread_attr_destroy(&attr);
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+static void connect_close(connect_t* conn);
+#ifdef ENABLE_URING
+static void uring_close(connect_t* conn);
+#endif
+
+static uint64_t reactor_clock() {
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000ULL + now.tv_nsec / 1000000;
+}
+
+static int reactor_idle(reactor_t* reactor) {
+
+	if (!reactor->server->idle || reactor->idle.wheel)
+		return 0;
+
+	pthread_mutex_init(&reactor->idle.mutex, NULL);
+	reactor->idle.now = reactor_clock();
+	return (reactor->idle.wheel = wheels_create(IDLE_TICK_MS, reactor->idle.now)) ? 0 : -1;
+}
+
+// connection is watched before it is armed, the reactor may close it right after
+static void connect_watch(connect_t* conn) {
+
+	reactor_t* reactor = conn->reactor;
+	if (!reactor->idle.wheel)
+		return;
+
+	conn->idle.timer.data = conn;
+	conn->idle.last = reactor_clock();
+
+	pthread_mutex_lock(&reactor->idle.mutex);
+	wheels_add(reactor->idle.wheel, &conn->idle.timer, conn->server->idle * 1000ULL);
+	pthread_mutex_unlock(&reactor->idle.mutex);
+}
+
+static void connect_unwatch(connect_t* conn) {
+
+	reactor_t* reactor = conn->reactor;
+	if (!reactor->idle.wheel)
+		return;
+
+	pthread_mutex_lock(&reactor->idle.mutex);
+	wheels_del(reactor->idle.wheel, &conn->idle.timer);
+	pthread_mutex_unlock(&reactor->idle.mutex);
+}
+
+// expired entry of connection with input since is put back for the rest of the timeout
+static void reactor_reap(reactor_t* reactor) {
+
+	server_t* server = reactor->server;
+	uint64_t timeout = server->idle * 1000ULL;
+
+	pthread_mutex_lock(&reactor->idle.mutex);
+	wheels_timer_t* timer = wheels_expire(reactor->idle.wheel, reactor->idle.now);
+	pthread_mutex_unlock(&reactor->idle.mutex);
+
+	while (timer) {
+		wheels_timer_t* next = timer->next;
+		connect_t* conn = timer->data;
+		uint64_t idle = reactor->idle.now > conn->idle.last ? reactor->idle.now - conn->idle.last : 0;
+
+		pthread_mutex_lock(&conn->mutex);
+		int waiting = conn->busy || conn->out.size || conn->out.head || conn->admit.paused;
+		pthread_mutex_unlock(&conn->mutex);
+
+		// running requests, unsent answers, subscriptions and whole messages held by admission wait for the server,
+		// idle time counts from the end of them, input is owned by this reactor thread
+		if (waiting || __atomic_load_n(&conn->subscribed, __ATOMIC_SEQ_CST) || conn->in.held || framer_ready(conn->framer)) {
+			conn->idle.last = reactor->idle.now;
+			idle = 0;
+		}
+
+		if (idle < timeout) {
+			pthread_mutex_lock(&reactor->idle.mutex);
+			wheels_add(reactor->idle.wheel, timer, timeout - idle);
+			pthread_mutex_unlock(&reactor->idle.mutex);
+		}
+
+		else {
+			DEBUG("client %d idle for %lu ms, closed", conn->stat.count, idle);
+			__sync_fetch_and_add(&server->stat.reaped, 1);
+#ifdef ENABLE_URING
+			if (reactor->uring)
+				uring_close(conn);
+			else
+#endif
+			connect_close(conn);
+		}
+
+		timer = next;
+	}
+}
+
+static int connect_ready(connect_t* conn, uint32_t flags) {
+
+	pthread_mutex_lock(&conn->mutex);
+	int ready = !conn->out.size && !conn->out.head && (!conn->busy || (flags & FRAME_FLAG_ID));
+
+	// reads stop while admission is full, so tcp backpressure reaches the client
+	if (ready && conn->server->admit.pause)
+		ready = connect_room(conn);
+	pthread_mutex_unlock(&conn->mutex);
+	return ready;
+}
+
+static void connect_close(connect_t* conn) {
+
+	conn->closed = 1;
+	connect_unwatch(conn);
+	epoll_ctl(conn->reactor->epfd, EPOLL_CTL_DEL, conn->sock, NULL);
+	connect_release(conn);
+}
+
+// return 1 when more bytes needed, 0 when frames wait for answers in flight
+static int connect_frames(connect_t* conn) {
+
+	while (1) {
+		// collected message waits for answers in flight
+		if (conn->in.held) {
+			if (!connect_ready(conn, conn->in.flags))
+				return 0;
+
+			int res = connect_dispatch(conn, conn->in.flags, conn->in.id, conn->in.buffer, conn->in.used);
+			free(conn->in.buffer);
+			conn->in.buffer = NULL;
+			conn->in.used = 0;
+			conn->in.held = 0;
+
+			if (res)
+				return -1;
+
+			continue;
+		}
+
+		uint32_t flags, id, size;
+		const char* data;
+		int res = framer_frame(conn->framer, &flags, &id, &data, &size);
+		if (res < 0)
+			return -1;
+
+		if (!res)
+			return 1;
+
+		// chunks are collected until the whole message is readed
+		if ((flags & FRAME_FLAG_MORE) || conn->in.used) {
+			if (conn->in.used + size > IO_MESSAGE_SIZE)
+				return -1;
+
+			char* buffer = realloc(conn->in.buffer, conn->in.used + size + 1);
+			if (!buffer)
+				return -1;
+
+			conn->in.buffer = buffer;
+			memcpy(&buffer[conn->in.used], data, size);
+			conn->in.used += size;
+			framer_drop(conn->framer);
+
+			if (!(flags & FRAME_FLAG_MORE)) {
+				conn->in.flags = flags;
+				conn->in.id = id;
+				conn->in.held = 1;
+			}
+
+			continue;
+		}
+
+		// frames without request id wait for answers in flight
+		if (!connect_ready(conn, flags))
+			return 0;
+
+		res = connect_dispatch(conn, flags, id, data, size);
+		framer_drop(conn->framer);
+
+		if (res)
+			return -1;
+	}
+
+	return 0;
+}
+
+static int connect_input(connect_t* conn) {
+
+	while (1) {
+		int res = connect_frames(conn);
+		if (res <= 0)
+			return res;
+
+		// do not read next frames while previous answers not sent
+		if (!connect_ready(conn, FRAME_FLAG_ID))
+			return 0;
+
+		int msgsize = framer_fill(conn->framer);
+		if (msgsize == 0)
+			return -1;
+
+		if (msgsize < 0) {
+			if (errno == EINTR)
+				continue;
+
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return 0;
+
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void reactor_accept(server_t* server, shard_t* shard, reactor_t* reactor);
+
+static void reactor_thread(reactor_t* reactor) {
+
+	struct epoll_event events[REACTOR_EVENTS];
+	int timeout = reactor->idle.wheel ? IDLE_TICK_MS : -1;
+
+	while (1) {
+		int count = epoll_wait(reactor->epfd, events, REACTOR_EVENTS, timeout);
+		if (count < 0) {
+			if (errno == EINTR)
+				continue;
+
+			ERROR("epoll_wait: %s", strerror(errno));
+			break;
+		}
+
+		// one clock read per wakeup stamps every input of it
+		if (reactor->idle.wheel)
+			reactor->idle.now = reactor_clock();
+
+		int id;
+		for (id = 0; id < count; id ++) {
+			connect_t* conn = events[id].data.ptr;
+			if (events[id].data.ptr == reactor)
+				continue;
+
+			// this reactor listener shard, with fewer shards than reactors connections go round-robin like unsharded ones
+			if (!conn) {
+				server_t* server = reactor->server;
+				reactor_accept(server, reactor->shard, server->shards < server->reactors ? NULL : reactor);
+				continue;
+			}
+
+			int res = 0;
+			if (events[id].events & EPOLLERR)
+				res = -1;
+
+			if (!res && (events[id].events & EPOLLOUT)) {
+				pthread_mutex_lock(&conn->mutex);
+				res = connect_pump(conn);
+
+				// pushed events follow once answers are out, out buffer never holds more than one batch
+				if (!res && !conn->out.buffer && !conn->out.head && connect_pending(conn)) {
+					conn->out.buffer = event_frames(connect_events(conn), &conn->out.size);
+					conn->out.writed = 0;
+					res = connect_flush(conn);
+				}
+				pthread_mutex_unlock(&conn->mutex);
+			}
+
+			if (!res && (events[id].events & EPOLLIN))
+				conn->idle.last = reactor->idle.now;
+
+			if (!res)
+				res = connect_input(conn);
+
+			if (res)
+				connect_close(conn);
+		}
+
+		if (reactor->idle.wheel)
+			reactor_reap(reactor);
+
+		// resolve records replaced by request threads are freed here once nothing reads them
+		epochs_reclaim();
+
+		if (__atomic_load_n(&reactor->stop, __ATOMIC_SEQ_CST))
+			break;
+	}
+}
+
+#ifdef ENABLE_URING
+static int uring_start(reactor_t* reactor);
+#endif
+
+static int reactor_start(server_t* server) {
+
+	if (!(server->reactor = calloc(server->reactors, sizeof(reactor_t))))
+		return -1;
+
+	int id;
+#ifdef ENABLE_URING
+	for (id = 0; server->uring && id < server->reactors; id ++) {
+		reactor_t* reactor = &server->reactor[id];
+		reactor->server = server;
+		reactor->shard = &server->shard[id % server->shards];
+
+		if (reactor_idle(reactor))
+			return -1;
+
+		if (uring_start(reactor)) {
+			if (!id) {
+				WARN("io_uring not usable, fall back to epoll reactors");
+				server->uring = 0;
+				break;
+			}
+
+			return -1;
+		}
+
+		if (id + 1 == server->reactors) {
+			INFO("started %d io_uring reactors", server->reactors);
+			return 0;
+		}
+	}
+#endif
+	for (id = 0; id < server->reactors; id ++) {
+		reactor_t* reactor = &server->reactor[id];
+		reactor->server = server;
+
+		if (reactor_idle(reactor))
+			return -1;
+
+		if ((reactor->epfd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+			ERROR("epoll_create: %s", strerror(errno));
+			return -1;
+		}
+
+		// sharded listeners are accepted by its own reactor
+		if (server->shards > 1 && id < server->shards) {
+			reactor->shard = &server->shard[id];
+			struct epoll_event event = { .events = EPOLLIN, .data.ptr = NULL };
+			if (epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, reactor->shard->sock, &event) == -1) {
+				ERROR("epoll_ctl: %s", strerror(errno));
+				return -1;
+			}
+		}
+
+		// stop wakes the reactor through its eventfd, the reactor itself is the event data
+		struct epoll_event event = { .events = EPOLLIN, .data.ptr = reactor };
+		if ((reactor->evfd = eventfd(0, EFD_CLOEXEC)) == -1 || epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, reactor->evfd, &event) == -1) {
+			ERROR("eventfd: %s", strerror(errno));
+			return -1;
+		}
+
+		// reactors are joined by stop, nothing runs on server state after main returns
+		if (pthread_create(&reactor->td, NULL, (void*(*)(void*)) reactor_thread, reactor)) {
+			ERROR("pthread_create: %s", strerror(errno));
+			reactor->td = 0;
+			return -1;
+		}
+	}
+
+	INFO("started %d epoll reactors", server->reactors);
+	return 0;
+}
+
+// called by stop once connections are released, reactors are woken, joined and freed
+static void reactor_stop(server_t* server) {
+
+	if (!server->reactor)
+		return;
+
+	int id;
+	for (id = 0; id < server->reactors; id ++) {
+		reactor_t* reactor = &server->reactor[id];
+		if (!reactor->td)
+			continue;
+
+		__atomic_store_n(&reactor->stop, 1, __ATOMIC_SEQ_CST);
+		uint64_t one = 1;
+		if (write(reactor->evfd, &one, sizeof(one)) != sizeof(one))
+			WARN("eventfd: %s", strerror(errno));
+		pthread_join(reactor->td, NULL);
+	}
+
+	for (id = 0; id < server->reactors; id ++) {
+		reactor_t* reactor = &server->reactor[id];
+		if (reactor->epfd > 0)
+			close(reactor->epfd);
+		if (reactor->evfd > 0)
+			close(reactor->evfd);
+		urings_destroy(reactor->uring);
+		wheels_destroy(reactor->idle.wheel);
+		free(reactor->buffers);
+	}
+
+	free(server->reactor);
+	server->reactor = NULL;
+}
+
+static void reactor_connect(server_t* server, shard_t* shard, reactor_t* reactor, int sock, struct sockaddr_in* client) {
+
+	if (server_admit_connect(server)) {
+		close(sock);
+		return;
+	}
+
+	connect_t* conn = calloc(1, sizeof(*conn));
+	if (!conn) {
+		__sync_sub_and_fetch(&server->stat.connections, 1);
+		close(sock);
+		return;
+	}
+
+	conn->sock = sock;
+	conn->client = *client;
+
+	int optarg = 1;
+	setsockopt (conn->sock, SOL_SOCKET, SO_KEEPALIVE, &optarg, sizeof(optarg));
+	fcntl(conn->sock, F_SETFL, fcntl(conn->sock, F_GETFL) | O_NONBLOCK);
+
+	pthread_mutex_init(&conn->mutex, NULL);
+	pthread_mutex_init(&conn->event.mutex, NULL);
+	pthread_cond_init(&conn->cond, NULL);
+	conn->refs = 1;
+	conn->server = server;
+	conn->shard = shard;
+	conn->parser = parser_create();
+	conn->framer = framer_create(conn->sock);
+	conn->stat.count = __sync_fetch_and_add(&server->stat.count, 1);
+	connect_link(conn);
+	conn->reactor = reactor ? reactor : &server->reactor[conn->stat.count % server->reactors];
+	conn->events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+
+	if (!conn->parser || !conn->framer) {
+		connect_release(conn);
+		return;
+	}
+
+	DEBUG("client %d connected", conn->stat.count);
+
+	connect_watch(conn);
+	struct epoll_event event = { .events = conn->events, .data.ptr = conn };
+	if (epoll_ctl(conn->reactor->epfd, EPOLL_CTL_ADD, conn->sock, &event) == -1) {
+		ERROR("epoll_ctl: %s", strerror(errno));
+		connect_unwatch(conn);
+		connect_release(conn);
+	}
+}
+
+static void reactor_accept(server_t* server, shard_t* shard, reactor_t* reactor) {
+
+	struct sockaddr_in client = { 0 };
+	int sock, burst = 0;
+
+	// whole backlog is taken on every listener wakeup
+	while ((sock = shard_accept(shard, &client)) != -1) {
+		reactor_connect(server, shard, reactor, sock, &client);
+		burst ++;
+	}
+
+	shard_wakeup(shard, burst);
+}
+
+#ifdef ENABLE_URING
+static void uring_provide(reactor_t* reactor, int bid, int count) {
+
+	struct io_uring_sqe* sqe = urings_sqe(reactor->uring);
+	if (!sqe)
+		return;
+
+	sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+	sqe->fd = count;
+	sqe->addr = (uintptr_t)&reactor->buffers[bid * URING_BUFFER_SIZE];
+	sqe->len = URING_BUFFER_SIZE;
+	sqe->off = bid;
+	sqe->buf_group = URING_GROUP;
+	sqe->user_data = URING_BUFFER;
+}
+
+static int uring_accept(reactor_t* reactor, shard_t* shard) {
+
+	struct io_uring_sqe* sqe = urings_sqe(reactor->uring);
+	if (!sqe)
+		return -1;
+
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = shard->sock;
+	sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+	sqe->accept_flags = SOCK_CLOEXEC;
+	sqe->user_data = (uintptr_t)shard | URING_ACCEPT;
+	return 0;
+}
+
+static int uring_recv(reactor_t* reactor, connect_t* conn) {
+
+	struct io_uring_sqe* sqe = urings_sqe(reactor->uring);
+	if (!sqe)
+		return -1;
+
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = conn->sock;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = URING_GROUP;
+	sqe->user_data = (uintptr_t)conn | URING_RECV;
+	conn->uring.recv = 1;
+	return 0;
+}
+
+static int uring_cancel(reactor_t* reactor, connect_t* conn) {
+
+	struct io_uring_sqe* sqe = urings_sqe(reactor->uring);
+	if (!sqe)
+		return -1;
+
+	// armed recv ends with -ECANCELED, bytes already taken still come before it
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = (uintptr_t)conn | URING_RECV;
+	sqe->user_data = URING_CANCEL;
+	return 0;
+}
+
+static int uring_timer(reactor_t* reactor) {
+
+	struct io_uring_sqe* sqe = urings_sqe(reactor->uring);
+	if (!sqe)
+		return -1;
+
+	// pure timeout, completes with -ETIME every tick
+	sqe->opcode = IORING_OP_TIMEOUT;
+	sqe->fd = -1;
+	sqe->addr = (uintptr_t)&reactor->idle.tick;
+	sqe->len = 1;
+	sqe->user_data = URING_TIMER;
+	return 0;
+}
+
+static int uring_event(reactor_t* reactor) {
+
+	struct io_uring_sqe* sqe = urings_sqe(reactor->uring);
+	if (!sqe)
+		return -1;
+
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = reactor->evfd;
+	sqe->addr = (uintptr_t)&reactor->event;
+	sqe->len = sizeof(reactor->event);
+	sqe->user_data = URING_EVENT;
+	return 0;
+}
+
+static void uring_close(connect_t* conn) {
+
+	// multishot recv ends with the shutdown and drops the connection
+	conn->uring.closed = 1;
+	conn->closed = 1;
+	shutdown(conn->sock, SHUT_RDWR);
+
+	// stopped connection has no recv to end, uring_ready drops it
+	if (conn->uring.stopped && !conn->uring.recv)
+		uring_kick(conn);
+}
+
+// input held by admission stops the recv, so tcp backpressure reaches the client like with epoll,
+// it is armed again when a kick lets the held frames go
+static int uring_input(reactor_t* reactor, connect_t* conn) {
+
+	int res = connect_frames(conn);
+	if (res < 0)
+		return -1;
+
+	if (!conn->server->admit.pause)
+		return 0;
+
+	if (!res && conn->uring.recv && !conn->uring.stopped) {
+		conn->uring.stopped = 1;
+		if (uring_cancel(reactor, conn))
+			return -1;
+	}
+
+	else if (res > 0 && conn->uring.stopped) {
+		conn->uring.stopped = 0;
+		if (!conn->uring.recv && uring_recv(reactor, conn)) {
+			conn->uring.stopped = 1;
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void uring_kick(connect_t* conn) {
+
+	reactor_t* reactor = conn->reactor;
+
+	pthread_mutex_lock(&conn->mutex);
+	conn->refs ++;
+	pthread_mutex_unlock(&conn->mutex);
+
+	pthread_mutex_lock(&reactor->mutex);
+	int queued = conn->uring.ready;
+	if (!queued) {
+		conn->uring.ready = 1;
+		conn->uring.next = reactor->ready;
+		reactor->ready = conn;
+	}
+	pthread_mutex_unlock(&reactor->mutex);
+
+	if (queued)
+		connect_release(conn);
+
+	// reactor thread looks at the ready list before it waits
+	else if (!pthread_equal(pthread_self(), reactor->td)) {
+		uint64_t one = 1;
+		if (write(reactor->evfd, &one, sizeof(one)) != sizeof(one))
+			WARN("eventfd: %s", strerror(errno));
+	}
+}
+
+static void uring_flush(reactor_t* reactor, connect_t* conn) {
+
+	if (conn->uring.closed || conn->uring.flight)
+		return;
+
+	pthread_mutex_lock(&conn->mutex);
+	int res = uring_pump(conn);
+
+	// pushed events follow once answers are sent
+	if (!conn->uring.head && !conn->out.size && !conn->out.head && connect_pending(conn)) {
+		uint32_t size;
+		char* out = event_frames(connect_events(conn), &size);
+		if (out && uring_queue(conn, out, size))
+			free(out);
+	}
+
+	send_t* send = conn->uring.head;
+	conn->uring.head = conn->uring.tail = NULL;
+	pthread_mutex_unlock(&conn->mutex);
+
+	if (res)
+		uring_close(conn);
+
+	// queued answers go as one chain of linked sends, kernel keeps their order
+	int count = 0;
+	while (send) {
+		send_t* next = send->next;
+		send->next = NULL;
+
+		struct io_uring_sqe* sqe = urings_sqe(reactor->uring);
+		if (!sqe) {
+			send->next = next;
+			pthread_mutex_lock(&conn->mutex);
+			conn->uring.head = send;
+			while (send->next)
+				send = send->next;
+			conn->uring.tail = send;
+			pthread_mutex_unlock(&conn->mutex);
+			uring_close(conn);
+			break;
+		}
+
+		sqe->opcode = IORING_OP_SEND;
+		sqe->fd = conn->sock;
+		sqe->addr = (uintptr_t)&send->buffer[send->sent];
+		sqe->len = send->size - send->sent;
+		sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+		sqe->flags = next ? IOSQE_IO_LINK : 0;
+		sqe->user_data = (uintptr_t)send | URING_SEND;
+
+		count ++;
+		send = next;
+	}
+
+	conn->uring.flight += count;
+	pthread_mutex_lock(&conn->mutex);
+	conn->refs += count;
+	pthread_mutex_unlock(&conn->mutex);
+}
+
+static void uring_ready(reactor_t* reactor) {
+
+	while (1) {
+		pthread_mutex_lock(&reactor->mutex);
+		connect_t* conn = reactor->ready;
+		reactor->ready = NULL;
+
+		connect_t* it;
+		for (it = conn; it; it = it->uring.next)
+			it->uring.ready = 0;
+		pthread_mutex_unlock(&reactor->mutex);
+
+		if (!conn)
+			break;
+
+		while (conn) {
+			connect_t* next = conn->uring.next;
+			if (!conn->uring.closed && uring_input(reactor, conn))
+				uring_close(conn);
+
+			uring_flush(reactor, conn);
+
+			// the reference of the stopped recv goes with the connection
+			if (conn->uring.closed && conn->uring.stopped && !conn->uring.recv) {
+				conn->uring.stopped = 0;
+				connect_unwatch(conn);
+				connect_release(conn);
+			}
+
+			connect_release(conn);
+			conn = next;
+		}
+	}
+}
+
+static void uring_accepted(reactor_t* reactor, shard_t* shard, int res, uint32_t flags) {
+
+	// listener shut down by stop fails the accept, it is not armed again
+	if (server_stopping(reactor->server)) {
+		if (res >= 0)
+			close(res);
+		return;
+	}
+
+	if (!(flags & IORING_CQE_F_MORE))
+		uring_accept(reactor, shard);
+
+	shard_count(shard, res < 0 ? -1 : res);
+	if (res < 0) {
+		WARN("accept: %s", strerror(-res));
+		return;
+	}
+
+	if (server_admit_connect(reactor->server)) {
+		close(res);
+		return;
+	}
+
+	connect_t* conn = calloc(1, sizeof(*conn));
+	if (!conn) {
+		__sync_sub_and_fetch(&reactor->server->stat.connections, 1);
+		close(res);
+		return;
+	}
+
+	conn->sock = res;
+	int optarg = 1;
+	setsockopt (conn->sock, SOL_SOCKET, SO_KEEPALIVE, &optarg, sizeof(optarg));
+
+	pthread_mutex_init(&conn->mutex, NULL);
+	pthread_mutex_init(&conn->event.mutex, NULL);
+	pthread_cond_init(&conn->cond, NULL);
+	conn->refs = 1;
+	conn->server = reactor->server;
+	conn->shard = shard;
+	conn->reactor = reactor;
+	conn->parser = parser_create();
+	conn->framer = framer_create(conn->sock);
+	conn->stat.count = __sync_fetch_and_add(&reactor->server->stat.count, 1);
+	connect_link(conn);
+
+	// the armed recv owns the first reference
+	connect_watch(conn);
+	if (!conn->parser || !conn->framer || uring_recv(reactor, conn)) {
+		connect_unwatch(conn);
+		connect_release(conn);
+		return;
+	}
+
+	DEBUG("client %d connected", conn->stat.count);
+}
+
+static void uring_received(reactor_t* reactor, connect_t* conn, int res, uint32_t flags) {
+
+	if (res > 0) {
+		conn->idle.last = reactor->idle.now;
+		int bid = flags >> IORING_CQE_BUFFER_SHIFT;
+		int err = framer_feed(conn->framer, &reactor->buffers[bid * URING_BUFFER_SIZE], res);
+		uring_provide(reactor, bid, 1);
+
+		if (!conn->uring.closed && (err || uring_input(reactor, conn)))
+			uring_close(conn);
+
+		uring_flush(reactor, conn);
+	}
+
+	if (flags & IORING_CQE_F_MORE)
+		return;
+
+	// stopped recv keeps its reference until uring_input arms it again
+	conn->uring.recv = 0;
+	if (!conn->uring.closed && conn->uring.stopped)
+		return;
+
+	if (!conn->uring.closed && (res > 0 || res == -ENOBUFS || res == -ECANCELED) && !uring_recv(reactor, conn))
+		return;
+
+	uring_close(conn);
+	conn->uring.stopped = 0;
+	connect_unwatch(conn);
+	connect_release(conn);
+}
+
+static void uring_sent(reactor_t* reactor, send_t* send, int res) {
+
+	connect_t* conn = send->conn;
+	conn->uring.flight --;
+
+	if (res > 0)
+		send->sent += res;
+
+	// sends after a failed link are canceled, they are sent again in order
+	if (send->sent != send->size && !conn->uring.closed && (res > 0 || res == -ECANCELED || res == -EINTR || res == -EAGAIN)) {
+		if (conn->uring.last)
+			conn->uring.last->next = send;
+		else	conn->uring.retry = send;
+		conn->uring.last = send;
+	}
+
+	else {
+		if (send->sent != send->size)
+			uring_close(conn);
+
+		pthread_mutex_lock(&conn->mutex);
+		conn->out.size -= send->size;
+		pthread_mutex_unlock(&conn->mutex);
+
+		free(send->buffer);
+		free(send);
+	}
+
+	if (!conn->uring.flight) {
+		if (conn->uring.retry) {
+			pthread_mutex_lock(&conn->mutex);
+			conn->uring.last->next = conn->uring.head;
+			if (!conn->uring.head)
+				conn->uring.tail = conn->uring.last;
+			conn->uring.head = conn->uring.retry;
+			pthread_mutex_unlock(&conn->mutex);
+			conn->uring.retry = conn->uring.last = NULL;
+		}
+
+		// frames held while answers were sent
+		else if (!conn->uring.closed && uring_input(reactor, conn))
+			uring_close(conn);
+
+		uring_flush(reactor, conn);
+	}
+
+	connect_release(conn);
+}
+
+static void uring_thread(reactor_t* reactor) {
+
+	while (1) {
+		uring_ready(reactor);
+
+		if (urings_submit(reactor->uring, 1) < 0) {
+			ERROR("io_uring_enter: %s", strerror(errno));
+			break;
+		}
+
+		if (reactor->idle.wheel)
+			reactor->idle.now = reactor_clock();
+
+		struct io_uring_cqe* cqe;
+		while ((cqe = urings_cqe(reactor->uring))) {
+			uint64_t data = cqe->user_data;
+			int res = cqe->res;
+			uint32_t flags = cqe->flags;
+			urings_seen(reactor->uring);
+
+			void* ptr = (void*)(uintptr_t)(data & ~(uint64_t)URING_MASK);
+			switch (data & URING_MASK) {
+				case URING_ACCEPT:
+					uring_accepted(reactor, ptr, res, flags);
+					break;
+
+				case URING_RECV:
+					uring_received(reactor, ptr, res, flags);
+					break;
+
+				case URING_SEND:
+					uring_sent(reactor, ptr, res);
+					break;
+
+				case URING_EVENT:
+					uring_event(reactor);
+					break;
+
+				case URING_BUFFER:
+					if (res < 0)
+						WARN("provide buffers: %s", strerror(-res));
+					break;
+
+				case URING_TIMER:
+					uring_timer(reactor);
+					break;
+
+				case URING_CANCEL:
+					break;
+			}
+		}
+
+		if (reactor->idle.wheel)
+			reactor_reap(reactor);
+
+		// resolve records replaced by request threads are freed here once nothing reads them
+		epochs_reclaim();
+
+		if (__atomic_load_n(&reactor->stop, __ATOMIC_SEQ_CST))
+			break;
+	}
+}
+
+static int uring_start(reactor_t* reactor) {
+
+	pthread_mutex_init(&reactor->mutex, NULL);
+
+	if (!(reactor->uring = urings_create(URING_ENTRIES)))
+		return -1;
+
+	if ((reactor->evfd = eventfd(0, EFD_CLOEXEC)) == -1) {
+		ERROR("eventfd: %s", strerror(errno));
+		return -1;
+	}
+
+	if (!(reactor->buffers = malloc(URING_BUFFERS * URING_BUFFER_SIZE)))
+		return -1;
+
+	reactor->idle.tick.tv_sec = IDLE_TICK_MS / 1000;
+	reactor->idle.tick.tv_nsec = (IDLE_TICK_MS % 1000) * 1000000L;
+
+	uring_provide(reactor, 0, URING_BUFFERS);
+	if (uring_event(reactor) || uring_accept(reactor, reactor->shard) || (reactor->idle.wheel && uring_timer(reactor)) || urings_submit(reactor->uring, 0) < 0) {
+		ERROR("io_uring submit: %s", strerror(errno));
+		return -1;
+	}
+
+	int res = pthread_create(&reactor->td, NULL, (void*(*)(void*)) uring_thread, reactor);
+	if (res) {
+		ERROR("pthread_create: %s", strerror(res));
+		reactor->td = 0;
+		return -1;
+	}
+
+	return 0;
+}
+#endif
+#endif
+
+#ifdef ENABLE_UDP
+static void dgram_run(dgram_t* dgram) {
+
+	udp_t* udp = dgram->udp;
+	uint32_t hsize = HEADER_MSG_SIZE + ((dgram->flags & FRAME_FLAG_ID) ? FRAME_ID_SIZE : 0);
+
+	arenas_t* arena = json_node_arena(dgram->arena);
+	json_node_t* answer = target_answer(udp->conn, udp->conn->server, dgram->request, &dgram->deadline);
+	json_node_destroy(dgram->request);
+	dgram->request = NULL;
+
+	int left = FRAME_DATAGRAM_SIZE - hsize;
+	dgram->reply[hsize] = '\0';
+	if (json_node_print(answer, JSON_STYLE_MINIMAL, &left, &dgram->reply[hsize])) {
+		snprintf(&dgram->reply[hsize], FRAME_DATAGRAM_SIZE - hsize, "{\"error\":\"answer exceeds datagram\"}");
+		left = FRAME_DATAGRAM_SIZE - hsize - strlen(&dgram->reply[hsize]);
+	}
+
+	json_node_destroy(answer);
+	json_node_arena(arena);
+
+	uint32_t header[2] = { (FRAME_DATAGRAM_SIZE - hsize - left) | dgram->flags, dgram->id };
+	memcpy(dgram->reply, header, hsize);
+	dgram->size = FRAME_DATAGRAM_SIZE - left;
+
+	// answers go out as they come, a slow call does not hold the others of its batch
+	pthread_mutex_lock(&udp->mutex);
+	dgram->next = NULL;
+	if (udp->tail)
+		udp->tail->next = dgram;
+	else	udp->head = dgram;
+	udp->tail = dgram;
+	pthread_mutex_unlock(&udp->mutex);
+
+	char c = 0;
+	if (write(udp->wake[1], &c, 1) < 0 && errno != EAGAIN)
+		WARN("udp wake: %s", strerror(errno));
+}
+
+static void udp_recycle(udp_t* udp, dgram_t* dgram) {
+
+	// a few spare requests keep their arena and reply buffer for the next batch
+	if (udp->spare >= UDP_BATCH) {
+		arenas_destroy(dgram->arena);
+		free(dgram);
+		return;
+	}
+
+	arenas_reset(dgram->arena);
+	dgram->next = udp->free;
+	udp->free = dgram;
+	udp->spare ++;
+}
+
+static void udp_flush(udp_t* udp) {
+
+	pthread_mutex_lock(&udp->mutex);
+	dgram_t* dgram = udp->head;
+	udp->head = udp->tail = NULL;
+	pthread_mutex_unlock(&udp->mutex);
+
+	struct mmsghdr smsg[UDP_BATCH];
+	struct iovec siov[UDP_BATCH];
+	dgram_t* batch[UDP_BATCH];
+
+	while (dgram) {
+		int answers = 0;
+		for (; dgram && answers < UDP_BATCH; dgram = dgram->next) {
+			siov[answers].iov_base = dgram->reply;
+			siov[answers].iov_len = dgram->size;
+			memset(&smsg[answers], 0, sizeof(smsg[answers]));
+			smsg[answers].msg_hdr.msg_name = &dgram->client;
+			smsg[answers].msg_hdr.msg_namelen = dgram->namelen;
+			smsg[answers].msg_hdr.msg_iov = &siov[answers];
+			smsg[answers].msg_hdr.msg_iovlen = 1;
+			batch[answers ++] = dgram;
+		}
+
+		int sent = 0;
+		while (sent < answers) {
+			int msgs = sendmmsg(udp->sock, &smsg[sent], answers - sent, 0);
+			if (msgs < 0) {
+				if (errno == EINTR)
+					continue;
+
+				WARN("sendmmsg: %s", strerror(errno));
+				break;
+			}
+			sent += msgs;
+		}
+
+		int id;
+		for (id = 0; id < answers; id ++)
+			udp_recycle(udp, batch[id]);
+
+		pthread_mutex_lock(&udp->mutex);
+		udp->flight -= answers;
+		pthread_mutex_unlock(&udp->mutex);
+	}
+}
+
+static void udp_dispatch(udp_t* udp, const char* data, uint32_t len, struct sockaddr_in* client, socklen_t namelen) {
+
+	connect_t* conn = udp->conn;
+	server_t* server = conn->server;
+
+	uint32_t size, rid = 0;
+	if (len < HEADER_MSG_SIZE)
+		return;
+
+	memcpy(&size, data, HEADER_MSG_SIZE);
+	uint32_t hsize = HEADER_MSG_SIZE + ((size & FRAME_FLAG_ID) ? FRAME_ID_SIZE : 0);
+	if (len < hsize || (size & FRAME_SIZE_MASK) != len - hsize)
+		return;
+
+	// chunked messages are not reassembled from datagrams
+	if (size & FRAME_FLAG_MORE)
+		return;
+
+	if (size & FRAME_FLAG_ID)
+		memcpy(&rid, &data[HEADER_MSG_SIZE], FRAME_ID_SIZE);
+
+	dgram_t* dgram = udp->free;
+	if (dgram) {
+		udp->free = dgram->next;
+		udp->spare --;
+	}
+
+	else if ((dgram = malloc(sizeof(*dgram)))) {
+		if (!(dgram->arena = arenas_create(ARENA_SIZE))) {
+			free(dgram);
+			dgram = NULL;
+		}
+	}
+
+	if (!dgram) {
+		ERROR("udp request: %s", strerror(ENOMEM));
+		return;
+	}
+
+	conn->stat.reqst ++;
+	__sync_fetch_and_add(&server->stat.reqst, 1);
+
+	dgram->udp = udp;
+	dgram->flags = size & FRAME_FLAG_ID;
+	dgram->id = rid;
+	dgram->client = *client;
+	dgram->namelen = namelen;
+	dgram->deadline.set = 0;
+	dgram->deadline.cancel = NULL;
+	clock_gettime(CLOCK_MONOTONIC, &dgram->deadline.at);
+
+	// the listener parses, the request tree lives in the datagram arena
+	arenas_t* arena = json_node_arena(dgram->arena);
+	dgram->request = parser_parse_buffer(conn->parser, &data[hsize], size & FRAME_SIZE_MASK);
+	json_node_arena(arena);
+
+	pthread_mutex_lock(&udp->mutex);
+	udp->flight ++;
+	pthread_mutex_unlock(&udp->mutex);
+
+	// same pool as stream requests, without workers the listener runs it
+	if (!server->worker || worker_push(server->worker, (void(*)(void*)) dgram_run, dgram))
+		dgram_run(dgram);
+}
+
+static void udp_serve(shard_t* shard) {
+
+	server_t* server = shard->server;
+
+	connect_t conn = {
+		.server = server,
+		.parser = parser_create(),
+		.datagram = !0,
+		.client = { 0 },
+		.stat.count = __sync_fetch_and_add(&server->stat.count, 1),
+	};
+
+	udp_t udp = {
+		.conn = &conn,
+		.sock = shard->sock,
+		.wake = { -1, -1 },
+		.mutex = PTHREAD_MUTEX_INITIALIZER,
+	};
+
+	char* in = malloc(UDP_BATCH * FRAME_DATAGRAM_SIZE);
+
+	struct mmsghdr rmsg[UDP_BATCH];
+	struct iovec riov[UDP_BATCH];
+	struct sockaddr_in client[UDP_BATCH];
+
+	// workers wake the listener beside the socket when answers are ready
+	if (pipe2(udp.wake, O_CLOEXEC | O_NONBLOCK)) {
+		ERROR("pipe: %s", strerror(errno));
+		udp.wake[0] = udp.wake[1] = -1;
+	}
+
+	struct pollfd fds[2] = { { .fd = shard->sock, .events = POLLIN }, { .fd = udp.wake[0], .events = POLLIN } };
+
+	// shut down socket gives empty datagrams, stop is checked before every receive
+	while (in && udp.wake[0] != -1 && !server_stopping(server)) {
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+
+			ERROR("poll: %s", strerror(errno));
+			break;
+		}
+
+		if (fds[1].revents) {
+			char drain[64];
+			while (read(udp.wake[0], drain, sizeof(drain)) > 0);
+		}
+
+		if (fds[0].revents) {
+			int id;
+			for (id = 0; id < UDP_BATCH; id ++) {
+				riov[id].iov_base = &in[id * FRAME_DATAGRAM_SIZE];
+				riov[id].iov_len = FRAME_DATAGRAM_SIZE;
+				memset(&rmsg[id], 0, sizeof(rmsg[id]));
+				rmsg[id].msg_hdr.msg_name = &client[id];
+				rmsg[id].msg_hdr.msg_namelen = sizeof(client[id]);
+				rmsg[id].msg_hdr.msg_iov = &riov[id];
+				rmsg[id].msg_hdr.msg_iovlen = 1;
+			}
+
+			int count = recvmmsg(shard->sock, rmsg, UDP_BATCH, MSG_DONTWAIT, NULL);
+			if (count < 0 && errno != EINTR && errno != EAGAIN) {
+				ERROR("recvmmsg: %s", strerror(errno));
+				break;
+			}
+
+			for (id = 0; id < count; id ++)
+				udp_dispatch(&udp, &in[id * FRAME_DATAGRAM_SIZE], rmsg[id].msg_len, &client[id], rmsg[id].msg_hdr.msg_namelen);
+		}
+
+		udp_flush(&udp);
+	}
+
+	// requests handed to workers still point to this frame, their answers are sent before leaving
+	while (1) {
+		udp_flush(&udp);
+
+		pthread_mutex_lock(&udp.mutex);
+		int flight = udp.flight;
+		pthread_mutex_unlock(&udp.mutex);
+
+		if (!flight)
+			break;
+
+		if (poll(&fds[1], 1, -1) > 0) {
+			char drain[64];
+			while (read(udp.wake[0], drain, sizeof(drain)) > 0);
+		}
+	}
+
+	while (udp.free) {
+		dgram_t* dgram = udp.free;
+		udp.free = dgram->next;
+		arenas_destroy(dgram->arena);
+		free(dgram);
+	}
+
+	if (udp.wake[0] != -1) {
+		close(udp.wake[0]);
+		close(udp.wake[1]);
+	}
+
+	free(in);
+	connect_handles(&conn);
+	parser_destroy(conn.parser);
+	pthread_mutex_destroy(&udp.mutex);
+}
+#endif
+
+#ifdef ENABLE_SHM
+static void shm_thread(connect_t* conn) {
+
+	// unix socket only passes the ring memfd and tells when the client is gone
+	if (!(conn->shm = shmrng_accept(conn->sock, SHM_RING_SIZE))) {
+		connect_release(conn);
+		return;
+	}
+
+	DEBUG("client %d connected over shared memory", conn->stat.count);
+
+	conn->arena = arenas_create(ARENA_SIZE);
+
+	char* buffer = NULL;
+	uint32_t used = 0;
+
+	while (1) {
+		uint32_t flags, id, size;
+		const char* data;
+		if (shmrng_read(conn->shm, &flags, &id, &data, &size)) {
+			// pushed events are written by this thread only, the ring has one producer
+			if (errno == EINTR && !connect_deliver(conn))
+				continue;
+			break;
+		}
+
+		// chunks are collected until the whole message is readed
+		if ((flags & FRAME_FLAG_MORE) || used) {
+			if (used + size > IO_MESSAGE_SIZE)
+				break;
+
+			char* message = realloc(buffer, used + size + 1);
+			if (!message)
+				break;
+
+			buffer = message;
+			memcpy(&buffer[used], data, size);
+			used += size;
+
+			if (flags & FRAME_FLAG_MORE)
+				continue;
+
+			data = buffer;
+			size = used;
+			used = 0;
+		}
+
+		conn->stat.reqst ++;
+		__sync_fetch_and_add(&conn->server->stat.reqst, 1);
+
+		deadline_t deadline = { .set = 0, .cancel = &conn->closed };
+		clock_gettime(CLOCK_MONOTONIC, &deadline.at);
+
+		// the ring has one consumer, requests run inline in arrival order
+		arenas_t* arena = json_node_arena(conn->arena);
+		json_node_t* request = parser_parse_buffer(conn->parser, data, size);
+		json_node_t* answer = target_answer(conn, conn->server, request, &deadline);
+		json_node_destroy(request);
+		connect_answer(conn, flags & FRAME_FLAG_ID, id, answer);
+		json_node_destroy(answer);
+		json_node_arena(arena);
+		arenas_reset(conn->arena);
+	}
+
+	free(buffer);
+	connect_release(conn);
+}
+
+static void shm_serve(shard_t* shard) {
+
+	server_t* server = shard->server;
+
+	while (!server_stopping(server)) {
+		connect_t* conn = calloc(1, sizeof(*conn));
+		if (!conn)
+			break;
+
+		if ((conn->sock = accept4(shard->sock, NULL, NULL, SOCK_CLOEXEC)) == -1) {
+			free(conn);
+			if (errno == EINTR || errno == ECONNABORTED || server_stopping(server))
+				continue;
+
+			ERROR("accept: %s", strerror(errno));
+			break;
+		}
+
+		shard_count(shard, conn->sock);
+		if (server_admit_connect(server)) {
+			close(conn->sock);
+			free(conn);
+			continue;
+		}
+
+		pthread_mutex_init(&conn->mutex, NULL);
+		pthread_mutex_init(&conn->event.mutex, NULL);
+		pthread_cond_init(&conn->cond, NULL);
+		conn->refs = 1;
+		conn->server = server;
+		conn->shard = shard;
+		conn->parser = parser_create();
+		conn->stat.count = __sync_fetch_and_add(&server->stat.count, 1);
+		connect_link(conn);
+
+		pthread_t td;
+		pthread_attr_t attr;
+		pthread_attr_init(&attr);
+		pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED);
+		if (pthread_create(&td, &attr, (void*(*)(void*)) shm_thread, conn)) {
+			ERROR("pthread_create: %s", strerror(errno));
+			connect_release(conn);
+		}
+		pthread_attr_destroy(&attr);
+	}
+}
+#endif
+
+static int server_shm(server_t* server) {
+
+#ifdef ENABLE_SHM
+	if (!strcmp(address_get_proto(server->address), "shm"))
+		return !0;
+#endif
+	return 0;
+}
+
+static int server_listen(server_t* server, int reuseport) {
+
+	int sock = -1;
+#ifdef ENABLE_TCP
+	if (!strcmp(address_get_proto(server->address), "tcp")) {
+		sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		int opt = 1;
+		if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof (opt)) == -1)
+			goto tcp_server_final;
+
+		// shards bind the same port, the kernel spreads connections between them
+		if (reuseport && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof (opt)) == -1)
+			goto tcp_server_final;
+
+		struct sockaddr_in srv = { 0 };
+		srv.sin_family = AF_INET;
+		srv.sin_port = htons (address_get_port(server->address));
+		inet_pton (AF_INET, address_get_host(server->address), &srv.sin_addr.s_addr);
+		if (bind (sock, (struct sockaddr *) &srv, sizeof (struct sockaddr_in)) == -1)
+			goto tcp_server_final;
+
+		if (listen (sock, server->backlog) == -1)
+			goto tcp_server_final;
+		return sock;
+
+		tcp_server_final:
+		ERROR ("server at '%s': %s", address_get_url(server->address), strerror (errno));
+		if (sock > 0)
+			close(sock);
+
+		return -1;
+	}
+#endif
+#ifdef ENABLE_UNIX
+	if (!strcmp(address_get_proto(server->address), "unix") || server_shm(server)) {
+		struct sockaddr_un srv;
+		socklen_t socksize = address_get_unix(server->address, &srv);
+		if (!socksize) {
+			errno = ENAMETOOLONG;
+			goto unix_server_final;
+		}
+
+		if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+			goto unix_server_final;
+
+		// socket file left by previous run, abstract names go away with their socket
+		if (srv.sun_path[0])
+			unlink(srv.sun_path);
+
+		if (bind (sock, (struct sockaddr *) &srv, socksize) == -1)
+			goto unix_server_final;
+
+		if (listen (sock, server->backlog) == -1)
+			goto unix_server_final;
+
+		return sock;
+
+		unix_server_final:
+		ERROR ("server at '%s': %s", address_get_url(server->address), strerror (errno));
+		if (sock > 0)
+			close(sock);
+
+		return -1;
+	}
+#endif
+#ifdef ENABLE_SCTP
+	if (!strcmp(address_get_proto(server->address), "sctp")) {
+		sock = socket(AF_INET, SOCK_STREAM, IPPROTO_SCTP);
+		int opt = 1;
+		if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) == -1)
+			goto sctp_server_final;
+
+		struct sockaddr_in srv = { 0 };
+		srv.sin_family = AF_INET;
+		srv.sin_port = htons(address_get_port(server->address));
+		inet_pton (AF_INET, address_get_host(server->address), &srv.sin_addr.s_addr);
+		if (bind (sock, (struct sockaddr *) &srv, sizeof (struct sockaddr_in)) == -1)
+			goto sctp_server_final;
+
+		if (listen (sock, server->backlog) == -1)
+			goto sctp_server_final;
+		return sock;
+
+		sctp_server_final:
+		ERROR ("server at '%s': %s", address_get_url(server->address), strerror (errno));
+		if (sock > 0)
+			close(sock);
+
+		return -1;
+	}
+#endif
+#ifdef ENABLE_UDP
+	if (!strcmp(address_get_proto(server->address), "udp")) {
+		sock = socket(AF_INET, SOCK_DGRAM, 0);
+		int opt = 1;
+		if (setsockopt (sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof (opt)) == -1)
+			goto udp_server_final;
+
+		struct sockaddr_in srv = { 0 };
+		srv.sin_family = AF_INET;
+		srv.sin_port = htons (address_get_port(server->address));
+		inet_pton (AF_INET, address_get_host(server->address), &srv.sin_addr.s_addr);
+		if (bind (sock, (struct sockaddr *) &srv, sizeof (struct sockaddr_in)) == -1)
+			goto udp_server_final;
+
+		return sock;
+
+		udp_server_final:
+		ERROR ("server at '%s': %s", address_get_url(server->address), strerror (errno));
+		if (sock > 0)
+			close(sock);
+
+		return -1;
+	}
+#endif
+	ERROR("protocol '%s' not compiled", address_get_proto(server->address));
+	return -1;
+}
+
+static void shard_serve(shard_t* shard) {
+
+	server_t* server = shard->server;
+
+	while (!server_stopping(server)) {
+		struct timeval timer = {.tv_sec = 1, .tv_usec = 0 };
+
+		fd_set rfds;
+		FD_ZERO(&rfds);
+		FD_SET (shard->sock, &rfds);
+
+		if (select (shard->sock + 1, &rfds, NULL, NULL, &timer) > 0) {
+#ifdef HAVE_SYS_EPOLL_H
+			if (server->reactors) {
+				reactor_accept(server, shard, NULL);
+				continue;
+			}
+#endif
+			struct sockaddr_in client = { 0 };
+			int sock, burst = 0;
+
+			// whole backlog is taken on every listener wakeup
+			while ((sock = shard_accept(shard, &client)) != -1) {
+				connect_spawn(server, shard, sock, &client);
+				burst ++;
+			}
+
+			shard_wakeup(shard, burst);
+		}
+	}
+}
+
+static int server_bind(server_t* server) {
+
+	if (server->shards > 1 && strcmp(address_get_proto(server->address), "tcp")) {
+		WARN("sharded listeners need tcp, '%s' uses one listener", address_get_url(server->address));
+		server->shards = 1;
+	}
+
+	// one listener per reactor
+	if (server->reactors && server->shards > server->reactors)
+		server->shards = server->reactors;
+
+	if (!(server->shard = calloc(server->shards, sizeof(shard_t))))
+		return -1;
+
+	int id;
+	for (id = 0; id < server->shards; id ++) {
+		shard_t* shard = &server->shard[id];
+		shard->server = server;
+		pthread_mutex_init(&shard->mutex, NULL);
+
+		if ((shard->sock = server_listen(server, server->shards > 1)) == -1)
+			return -1;
+
+		// accepting listeners drain the backlog until EAGAIN, datagram and shm sockets block
+		if (strcmp(address_get_proto(server->address), "udp") && !server_shm(server))
+			fcntl(shard->sock, F_SETFL, fcntl(shard->sock, F_GETFL) | O_NONBLOCK);
+	}
+
+	return 0;
+}
+
+static uint64_t confdir_usec(struct timespec* from) {
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - from->tv_sec) * 1000000 + (now.tv_nsec - from->tv_nsec) / 1000;
+}
+
+static void* confdir_thread(void* data) {
+
+	confdir_t* confdir = data;
+	parser_t* parser = parser_create();
+
+	int id;
+	while ((id = __sync_fetch_and_add(&confdir->next, 1)) < confdir->count) {
+		config_t* config = &confdir->config[id];
+
+		struct timespec start;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		if ((config->request = parser_parse_file(parser, config->name))) {
+			json_node_t* order = json_node_object_node(config->request, "order", JSON_NODE_TYPE_INTEGER);
+			if (order)
+				config->order = json_node_int_value(order);
+		}
+
+		config->parse = confdir_usec(&start);
+	}
+
+	parser_destroy(parser);
+	return NULL;
+}
+
+static int confdir_compare(const void* a, const void* b) {
+
+	const config_t* ca = a;
+	const config_t* cb = b;
+
+	if (ca->order != cb->order)
+		return ca->order < cb->order ? -1 : 1;
+
+	return strcmp(ca->name, cb->name);
+}
+
+static int confdir_slowest(const void* a, const void* b) {
+
+	const config_t* ca = *(config_t* const*)a;
+	const config_t* cb = *(config_t* const*)b;
+	uint64_t ta = ca->parse + ca->apply;
+	uint64_t tb = cb->parse + cb->apply;
+
+	return ta < tb ? 1 : ta > tb ? -1 : 0;
+}
+
+static void server_confdir(server_t* server) {
+
+	DIR *dir = opendir(server->confdir);
+	if (!dir) {
+		ERROR("can't open confdir '%s': %s", server->confdir, strerror(errno));
+		return;
+	}
+
+	confdir_t confdir = { 0 };
+	int size = 0, id;
+
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		if (entry->d_type != DT_REG)
+			continue;
+
+		if (confdir.count == size) {
+			config_t* config = realloc(confdir.config, (size ? size * 2 : 64) * sizeof(config_t));
+			if (!config)
+				break;
+			confdir.config = config;
+			size = size ? size * 2 : 64;
+		}
+
+		config_t* config = &confdir.config[confdir.count];
+		memset(config, 0, sizeof(config_t));
+		if (asprintf(&config->name, "%s/%s", server->confdir, entry->d_name) < 0)
+			break;
+		confdir.count ++;
+	}
+	closedir(dir);
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	// files are parsed in parallel, the main thread takes its share
+	int threads = server->workers < confdir.count ? server->workers : confdir.count;
+	pthread_t* td = calloc(threads > 1 ? threads - 1 : 1, sizeof(pthread_t));
+	int spawned = 0;
+
+	for (id = 0; td && id < threads - 1; id ++) {
+		if (pthread_create(&td[id], NULL, confdir_thread, &confdir))
+			break;
+		spawned ++;
+	}
+
+	confdir_thread(&confdir);
+
+	for (id = 0; id < spawned; id ++)
+		pthread_join(td[id], NULL);
+	free(td);
+
+	uint64_t parse = confdir_usec(&start);
+
+	// applied by optional "order" key then by name, whatever readdir returned
+	qsort(confdir.config, confdir.count, sizeof(config_t), confdir_compare);
+
+	connect_t conn = {
+		.server = server,
+		.client = { 0 },
+		.stat.count = server->stat.count ++,
+	};
 
-#define LISTEN_COUNT 5
+	clock_gettime(CLOCK_MONOTONIC, &start);
 
-typedef struct server_s server_t;
-typedef struct connect_s connect_t;
+	for (id = 0; id < confdir.count; id ++) {
+		config_t* config = &confdir.config[id];
+		if (!config->request) {
+			ERROR("confdir file '%s' not parsed", config->name);
+			continue;
+		}
 
-struct connect_s {
+		struct timespec begin;
+		clock_gettime(CLOCK_MONOTONIC, &begin);
 
-	int sock;
-	struct sockaddr_in client;
+		json_node_t* answer = target_answer(&conn, server, config->request, NULL);
+		json_node_destroy(config->request);
+		json_node_destroy(answer);
 
-	server_t* server;
-	parser_t* parser;
+		config->apply = confdir_usec(&begin);
+		DEBUG("confdir file '%s' order %d parsed in %lu us applied in %lu us", config->name, config->order, config->parse, config->apply);
+	}
 
-	struct {
-		loader_t* loader;
-		thread_t* thread;
-		method_t* method;
-	} target;
+	connect_handles(&conn);
 
-	struct {
-		int count;
-		int reqst;
-	} stat;
-};
+	INFO("confdir '%s' %d files parsed in %lu us by %d threads, applied in %lu us", server->confdir, confdir.count, parse, spawned + 1, confdir_usec(&start));
 
-struct server_s {
+	config_t** slowest = calloc(confdir.count ? confdir.count : 1, sizeof(config_t*));
+	if (slowest) {
+		for (id = 0; id < confdir.count; id ++)
+			slowest[id] = &confdir.config[id];
+		qsort(slowest, confdir.count, sizeof(config_t*), confdir_slowest);
 
-	int sock;
+		for (id = 0; id < confdir.count && id < CONFDIR_SLOWEST; id ++)
+			INFO("confdir slowest '%s' parsed in %lu us applied in %lu us", slowest[id]->name, slowest[id]->parse, slowest[id]->apply);
+		free(slowest);
+	}
 
-	pthread_t td;
-	pthread_cond_t cond;
-	pthread_mutex_t mutex;
+	for (id = 0; id < confdir.count; id ++)
+		free(confdir.config[id].name);
+	free(confdir.config);
+}
 
-	address_t* address;
-	rbtree_t* loader;
+// called on the thread changing state or property, event is queued once to every subscribed connection and sent by its io context
+static int server_subscribed(server_t* server, const char* module, const char* thread) {
 
-	struct {
-		int count;
-	} stat;
+	pthread_mutex_lock(&server->subscribe.mutex);
+	subscribe_t* subscribe;
+	for (subscribe = server->subscribe.list; subscribe; subscribe = subscribe->next) {
+		if ((!subscribe->module || !strcmp(subscribe->module, module)) && (!subscribe->thread || !strcmp(subscribe->thread, thread)))
+			break;
+	}
+	pthread_mutex_unlock(&server->subscribe.mutex);
 
-	char* confdir;
-};
+	return subscribe != NULL;
+}
 
-void target_request(connect_t* conn, server_t* server, json_node_t* request, json_node_t* answer) {
+static void server_observe(void* data, thread_t* thread, thread_event_t type, const char* name, const char* value) {
 
-	if (!conn || !server || !request || !answer)
+	server_t* server = data;
+	if (!__atomic_load_n(&server->subscribe.list, __ATOMIC_ACQUIRE))
 		return;
 
-	json_node_t* target = json_node_object_node(request, "target", JSON_NODE_TYPE_OBJECT);
-	json_node_t* args   = json_node_object_node(request, "args"  , JSON_NODE_TYPE_ANY);
+	const char* module = thread_module(thread)->name;
+	const char* tname = thread_name(thread);
 
-	json_node_t* module = json_node_object_node(target, "module", JSON_NODE_TYPE_STRING);
-	json_node_t* thread = json_node_object_node(target, "thread", JSON_NODE_TYPE_STRING);
-	json_node_t* method = json_node_object_node(target, "method", JSON_NODE_TYPE_STRING);
+	// changes nobody listens to are not printed
+	if (!server_subscribed(server, module, tname))
+		return;
 
-	if (module) {
-		if (thread) {
-			if (method) {
-				if (!(conn->target.loader = get_from_rbtree(conn->server->loader, json_node_string_value(module))))
-					json_node_object_add(answer, "error", json_node_string("module not found"));
+	// event is printed once, the module thread never waits for a subscriber
+	arenas_t* arena = json_node_arena(NULL);
+	json_node_t* event = json_node_object(NULL);
+	json_node_object_add(event, "event", json_node_string(type == THREAD_EVENT_STATE ? "state" : "property"));
+	json_node_object_add(event, "module", json_node_string(module));
+	json_node_object_add(event, "thread", json_node_string(tname));
+	if (type == THREAD_EVENT_STATE)
+		json_node_object_add(event, "state", json_node_string(value));
 
-				else {
-					locker_set(loader_locker(conn->target.loader), THREAD_LOCK_READ);
-					if (!(conn->target.thread = get_from_loader(conn->target.loader, json_node_string_value(thread))))
-						json_node_object_add(answer, "error", json_node_string("thread not found"));
+	else {
+		json_node_object_add(event, "property", json_node_string(name));
+		json_node_object_add(event, "value", json_node_string(value));
+	}
 
-					else {
-						if (!(conn->target.method = thread_method(conn->target.thread, json_node_string_value(method))))
-							json_node_object_add(answer, "error", json_node_string("method not found"));
+	// most events fit the stack buffer, values full of escapes take one frame from heap
+	char small[EVENT_PRINT_SIZE];
+	char* body = small;
+	int total = EVENT_PRINT_SIZE, left = total;
+	body[0] = '\0';
 
-						else {
-							if (conn->target.method->run)
-								conn->target.method->run(conn->target.thread, args, answer);
-						}
-					}
+	if (json_node_print(event, JSON_STYLE_MINIMAL, &left, body)) {
+		total = left = IO_BUFFER_SIZE;
+		if ((body = malloc(total)))
+			body[0] = '\0';
 
-					locker_set(loader_locker(conn->target.loader), THREAD_UNLOCK_READ);
-				}
-			}
-			else {
-				json_node_object_add(answer, "info", json_node_string("thread command"));
+		// events over one frame are dropped like those of a full queue
+		if (body && json_node_print(event, JSON_STYLE_MINIMAL, &left, body)) {
+			free(body);
+			body = NULL;
+		}
+	}
+
+	json_node_destroy(event);
+	json_node_arena(arena);
+
+	uint32_t size = total - left;
+	connect_t** conns = NULL;
+	int count = 0, kicks = 0, dropped = 0, events = 0;
+
+	pthread_mutex_lock(&server->subscribe.mutex);
+	uint64_t stamp = ++ server->subscribe.stamp;
+	subscribe_t* subscribe;
+	for (subscribe = server->subscribe.list; subscribe; subscribe = subscribe->next) {
+		if ((subscribe->module && strcmp(subscribe->module, module)) || (subscribe->thread && strcmp(subscribe->thread, tname)))
+			continue;
+
+		connect_t* conn = subscribe->conn;
+		if (conn->event.stamp == stamp)
+			continue;
+		conn->event.stamp = stamp;
+
+		int res = body ? connect_queue(conn, body, size) : -1;
+		if (res < 0) {
+			dropped ++;
+			continue;
+		}
+
+		events ++;
+		if (!res)
+			continue;
+
+		// connection being released drops its subscriptions under this mutex before its pipe and ring go
+		if (!conn->reactor) {
+			if (conn->shm)
+				shmrng_interrupt(conn->shm);
+			else if (write(conn->event.wake[1], "", 1) < 0 && errno != EAGAIN)
+				WARN("client %d event wake: %s", conn->stat.count, strerror(errno));
+			continue;
+		}
+
+		if (kicks == count) {
+			connect_t** grow = realloc(conns, sizeof(*conns) * (count = count ? count * 2 : 8));
+			if (!grow) {
+				count = kicks;
+				continue;
 			}
+			conns = grow;
 		}
-		else {
-			json_node_object_add(answer, "info", json_node_string("module command"));
+
+		pthread_mutex_lock(&conn->mutex);
+		if (conn->refs > 0) {
+			conn->refs ++;
+			conns[kicks ++] = conn;
 		}
+		pthread_mutex_unlock(&conn->mutex);
 	}
-	else {
-		json_node_object_add(answer, "info", json_node_string("kernel command"));
+	pthread_mutex_unlock(&server->subscribe.mutex);
+
+	// reactor sends queued events once the connection has no answers to send
+	int id;
+	for (id = 0; id < kicks; id ++) {
+		connect_kick(conns[id], 0);
+		connect_release(conns[id]);
 	}
+
+	if (events)
+		__sync_fetch_and_add(&server->subscribe.events, events);
+	if (dropped)
+		__sync_fetch_and_add(&server->subscribe.dropped, dropped);
+
+	free(conns);
+	if (body != small)
+		free(body);
 }
 
-void connect_thread(void* data) {
+static void server_unload(server_t* server) {
 
-	connect_t conn = *(connect_t*)data;
-	DEBUG("client %d connected", conn.stat.count);
+	// nothing is served anymore, retired records left behind are freed
+	epochs_synchronize();
+	epochs_reclaim();
 
-	pthread_mutex_lock(&conn.server->mutex);
-	pthread_cond_broadcast(&conn.server->cond);
-	pthread_mutex_unlock(&conn.server->mutex);
+	rbtree_iterator_t* it = rbtree_iterator_create(server->loader);
 
-	char buffer[IO_BUFFER_SIZE];
+	const char* key;
+	void* data;
 
-	while (1) {
-		conn.stat.reqst ++;
+	while (rbtree_iterate(it, &key, &data))
+		loader_destroy(data);
 
-		size_t size;
-		if (read(conn.sock, &size, HEADER_MSG_SIZE) != HEADER_MSG_SIZE)
-			break;
+	rbtree_iterator_destroy(it);
+	rbtree_destroy(server->loader);
+}
 
-		int readed = 0;
-		while (readed != size) {
-			int msgsize = read(conn.sock, &buffer[readed], size - readed);
-			if (msgsize <= 0)
-				break;
-			readed += msgsize;
-		}
+static void* server_serve(server_t* server) {
 
-		if (readed != size)
-			break;
+#ifdef ENABLE_UDP
+	if (!strcmp(address_get_proto(server->address), "udp"))
+		udp_serve(&server->shard[0]);
 
-		json_node_t* request = parser_parse_buffer(conn.parser, buffer, size);
-		json_node_t* answer = json_node_object(NULL);
-		target_request(&conn, conn.server, request, answer);
-		json_node_destroy(request);
+	else
+#endif
+#ifdef ENABLE_SHM
+	if (server_shm(server))
+		shm_serve(&server->shard[0]);
 
-		size = IO_BUFFER_SIZE;
-		if (IO_BUFFER_SIZE)
-			buffer[0] = '\0';
+	else
+#endif
+		shard_serve(&server->shard[0]);
 
-		if (json_node_print(answer, JSON_STYLE_MINIMAL, (int*)&size, buffer)) {
-			json_node_destroy(answer);
-			break;
+	// serving loop failed on its own, main is woken to exit
+	if (!server_stopping(server))
+		kill(getpid(), SIGTERM);
+
+	return NULL;
+}
+
+typedef struct {
+
+	thread_t** thread;
+	int count;
+	int size;
+} server_threads_t;
+
+static void server_started(void* data, thread_t* thread) {
+
+	server_threads_t* threads = data;
+	if (thread_state(thread) != THREAD_STATE_STARTED)
+		return;
+
+	if (threads->count == threads->size) {
+		thread_t** grow = realloc(threads->thread, sizeof(*grow) * (threads->size = threads->size ? threads->size * 2 : 16));
+		if (!grow)
+			return;
+		threads->thread = grow;
+	}
+
+	threads->thread[threads->count ++] = thread;
+}
+
+static void* server_stop_thread(thread_t* thread) {
+
+	thread_state_set(thread, THREAD_STATE_STOPPED);
+	return NULL;
+}
+
+// module routines may take a while to leave, they are stopped side by side
+static void server_stop_threads(server_t* server) {
+
+	server_threads_t threads = { NULL, 0, 0 };
+	rbtree_iterator_t* it = rbtree_iterator_create(server->loader);
+	void* loader;
+
+	while (rbtree_iterate(it, NULL, &loader))
+		loader_foreach(loader, server_started, &threads);
+	rbtree_iterator_destroy(it);
+
+	pthread_t* td = calloc(threads.count + 1, sizeof(pthread_t));
+	int id;
+	for (id = 0; id < threads.count; id ++) {
+		if (!td || pthread_create(&td[id], NULL, (void*(*)(void*)) server_stop_thread, threads.thread[id])) {
+			server_stop_thread(threads.thread[id]);
+			if (td)
+				td[id] = 0;
 		}
+	}
 
-		json_node_destroy(answer);
-		size = IO_BUFFER_SIZE - size;
+	for (id = 0; td && id < threads.count; id ++) {
+		if (td[id])
+			pthread_join(td[id], NULL);
+	}
 
-		if (write(conn.sock, &size, HEADER_MSG_SIZE) != HEADER_MSG_SIZE)
-			break;
+	INFO("%d module threads stopped", threads.count);
+	free(threads.thread);
+	free(td);
+}
 
-		if (write(conn.sock, buffer, size) != size)
-			break;
+// wait for requests to finish and, when asked, for connections to be released,
+// -1 once grace seconds are over or another signal came, grace below zero waits for the signal only
+static int server_wait(server_t* server, sigset_t* signals, int grace, int connections) {
+
+	struct timespec now, until;
+	clock_gettime(CLOCK_MONOTONIC, &until);
+	until.tv_sec += grace;
+
+	struct timespec poll = { .tv_sec = 0, .tv_nsec = SHUTDOWN_POLL_MS * 1000000L };
+	while (server->stat.flight || __atomic_load_n(&server->stat.running, __ATOMIC_SEQ_CST) || (connections && server->stat.connections)) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (grace >= 0 && (now.tv_sec > until.tv_sec || (now.tv_sec == until.tv_sec && now.tv_nsec >= until.tv_nsec)))
+			return -1;
+
+		if (sigtimedwait(signals, NULL, &poll) > 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+// connections left are shut down, calls still running on them see their deadline cancelled
+static void server_close(server_t* server) {
+
+	int count = 0;
+
+	pthread_mutex_lock(&server->open.mutex);
+	connect_t* conn;
+	for (conn = server->open.head; conn; conn = conn->link.next) {
+		conn->closed = 1;
+		shutdown(conn->sock, SHUT_RDWR);
+		count ++;
 	}
+	pthread_mutex_unlock(&server->open.mutex);
 
-	DEBUG("client %d disconnected", conn.stat.count);
+	if (count)
+		INFO("%d connections closed", count);
+}
 
-	parser_destroy(conn.parser);
-	close(conn.sock);
+// listeners are shut down, taken requests get grace seconds to finish, another signal cuts it short
+static int server_stop(server_t* server, sigset_t* signals) {
+
+	INFO("server stopping, %d s grace for requests in flight", server->grace);
+
+	__atomic_store_n(&server->stopping, 1, __ATOMIC_SEQ_CST);
+
+	int id;
+	for (id = 0; id < server->shards; id ++) {
+#ifdef HAVE_SYS_EPOLL_H
+		if (server->reactor && !server->uring && server->shards > 1)
+			epoll_ctl(server->reactor[id].epfd, EPOLL_CTL_DEL, server->shard[id].sock, NULL);
+#endif
+		shutdown(server->shard[id].sock, SHUT_RDWR);
+	}
+
+	if (server_wait(server, signals, server->grace, 0))
+		WARN("grace is over, %d requests in flight and %d calls running are cancelled", server->stat.flight, server->stat.running);
+
+	// cancelled calls return soon, one more signal leaves the modules loaded
+	server_close(server);
+	if (server_wait(server, signals, -1, !0)) {
+		ERROR("server stopped with %d requests in flight and %d calls running, modules are not unloaded", server->stat.flight, server->stat.running);
+		return -1;
+	}
+
+	// listener threads see stopping and return, reactors drop their listeners on stop
+	for (id = 0; id < server->shards; id ++) {
+		if (server->shard[id].td)
+			pthread_join(server->shard[id].td, NULL);
+	}
+
+#ifdef HAVE_SYS_EPOLL_H
+	reactor_stop(server);
+#endif
+	for (id = 0; id < server->shards; id ++)
+		close(server->shard[id].sock);
+
+	server_stop_threads(server);
+	return 0;
+}
+
+static void server_privileges(server_t* server) {
+
+	if (server->group) { // set process group
+		struct group *gid = getgrnam(server->group);
+		if (gid) {
+			if (setgid(gid->gr_gid))
+				printf("set group id error: %s\n", strerror(errno));
+			else	printf("set group id: %s\n", server->group);
+		}
+		else
+			printf("can't get gid from group: %s\n", server->group);
+	}
+
+	if (server->user) { // set process user
+		struct passwd *uid = getpwnam(server->user);
+		if (uid) {
+			if (setuid(uid->pw_uid))
+				printf("set user id error: %s\n", strerror(errno));
+			else	printf("set user id: %s\n", server->user);
+		}
+		else
+			printf("can't get uid from user: %s\n", server->user);
+	}
+}
+
+static void server_load(server_t* server, const char* file) {
+
+	loader_t* loader = loader_create(file);
+	if (loader) {
+		// nothing is served yet, the old snapshot can go right away
+		loader_t* loaded = get_from_rbtree(server->loader, loader_name(loader));
+		rbtree_t* loaders = server_register(server, loader);
+		if (!loaders)
+			loader_destroy(loader);
+		else {
+			rbtree_destroy(loaders);
+			loader_destroy(loaded);
+		}
+	}
 }
 
 int main (int argc, char *argv[]) {
 
 	signal(SIGPIPE, SIG_IGN);
 
+	// stop signals are taken by main with sigwait, every thread started later inherits the mask
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
 	server_t server = {
-		.cond    = PTHREAD_COND_INITIALIZER,
-		.mutex   = PTHREAD_MUTEX_INITIALIZER,
-		.loader  = rbtree_create(NULL, loader_destroy),
-		.sock    = 0,
+		.loader  = rbtree_create(NULL, NULL),
+		.reload  = PTHREAD_MUTEX_INITIALIZER,
+		.shards  = 1,
+		.backlog = LISTEN_COUNT,
+		.shard   = NULL,
 		.stat    = { 0 },
 		.confdir = NULL,
 		.address = NULL,
+		.user    = NULL,
+		.group   = NULL,
+#ifdef HAVE_SYS_EPOLL_H
+		.reactors = sysconf(_SC_NPROCESSORS_ONLN),
+#endif
+		.reactor = NULL,
+		.workers = sysconf(_SC_NPROCESSORS_ONLN),
+		.depth   = WORKER_QUEUE_DEPTH,
+		.worker  = NULL,
+		.admit   = { .mutex = PTHREAD_MUTEX_INITIALIZER },
+		.subscribe = { .mutex = PTHREAD_MUTEX_INITIALIZER },
+		.open    = { .mutex = PTHREAD_MUTEX_INITIALIZER },
+		.stopping = 0,
+		.grace   = SHUTDOWN_GRACE,
+		.idle    = 0,
 	};
 
+	const char** modules = calloc(argc, sizeof(*modules));
+	int loads = 0;
+
 	int argument;
-	while ((argument = getopt (argc, argv, "b:p:m:c:U:G:l:?h")) != -1) {
+	while ((argument = getopt (argc, argv, "b:s:L:r:e:w:q:g:i:C:F:f:Pp:m:c:U:G:l:?h")) != -1) {
 		switch (argument) {
 
 			case 'b': {
-				if (server.sock > 0)
-					close(server.sock);
-				server.sock = 0;
-				if (!(server.address = address_create(optarg)))
-					break;
-#ifdef ENABLE_TCP
-				if (!strcmp(address_get_proto(server.address), "tcp")) {
-					server.sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-					int opt = 1;
-					if (setsockopt(server.sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof (opt)) == -1)
-						goto tcp_server_final;
-
-					struct sockaddr_in srv = { 0 };
-					srv.sin_family = AF_INET;
-					srv.sin_port = htons (address_get_port(server.address));
-					inet_pton (AF_INET, address_get_host(server.address), &srv.sin_addr.s_addr);
-					if (bind (server.sock, (struct sockaddr *) &srv, sizeof (struct sockaddr_in)) == -1)
-						goto tcp_server_final;
-
-					if (listen (server.sock, LISTEN_COUNT) == -1)
-						goto tcp_server_final;
-					break;
-
-					tcp_server_final:
-					ERROR ("server at '%s': %s", address_get_url(server.address), strerror (errno));
-					if (server.sock > 0)
-						close(server.sock);
-
+				address_destroy(server.address);
+				if (!(server.address = address_create(optarg))) {
+					ERROR("invalid binding '%s'", optarg);
+					server_unload(&server);
 					return -1;
 				}
-#endif
-#ifdef ENABLE_UNIX
-				if (!strcmp(address_get_proto(server.address), "unix")) {
-					server.sock = socket(AF_LOCAL, SOCK_STREAM, 0);
-					unlink(address_get_host(server.address));
-					struct sockaddr_un srv = { 0 };
-					srv.sun_family = AF_LOCAL;
-					strncpy (srv.sun_path, address_get_host(server.address), sizeof (srv.sun_path));
-					socklen_t socksize = sizeof (srv.sun_path);
-					if (bind (server.sock, (struct sockaddr *) &srv, socksize) == -1)
-						goto unix_server_final;
-
-					if (listen (server.sock, LISTEN_COUNT) == -1)
-						goto unix_server_final;
+				break;
+			}
 
-					break;
+			case 'c': {
+				server.confdir = optarg;
+				break;
+			}
 
-					unix_server_final:
-					ERROR ("server at '%s': %s", address_get_url(server.address), strerror (errno));
-					if (server.sock > 0)
-						close(server.sock);
+			case 'r': { // epoll reactors count, 0 - thread per connection
+				server.reactors = atoi(optarg);
+#ifndef HAVE_SYS_EPOLL_H
+				if (server.reactors)
+					WARN("epoll reactors not compiled, use thread per connection");
+				server.reactors = 0;
+#endif
+				if (server.reactors < 0)
+					server.reactors = 0;
+				break;
+			}
 
-					return -1;
-				}
+			case 'e': { // reactors engine, epoll or uring
+				if (!strcmp(optarg, "uring")) {
+#ifdef ENABLE_URING
+					server.uring = 1;
+#else
+					WARN("io_uring reactors not compiled, use epoll");
 #endif
-#ifdef ENABLE_SCTP
-				if (!strcmp(address_get_proto(server.address), "sctp")) {
-					server.sock = socket(AF_INET, SOCK_STREAM, IPPROTO_SCTP);
-					int opt = 1;
-					if (setsockopt(server.sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) == -1)
-						goto sctp_server_final;
-
-					struct sockaddr_in srv = { 0 };
-					srv.sin_family = AF_INET;
-					srv.sin_port = htons(address_get_port(server.address));
-					inet_pton (AF_INET, address_get_host(server.address), &srv.sin_addr.s_addr);
-					if (bind (server.sock, (struct sockaddr *) &srv, sizeof (struct sockaddr_in)) == -1)
-						goto sctp_server_final;
-
-					if (listen (server.sock, LISTEN_COUNT) == -1)
-						goto sctp_server_final;
-					break;
+				}
 
-					sctp_server_final:
-					ERROR ("server at '%s': %s", address_get_url(server.address), strerror (errno));
-					if (server.sock > 0)
-						close(server.sock);
+				else if (strcmp(optarg, "epoll"))
+					WARN("unknown reactors engine '%s', use epoll", optarg);
 
-					return -1;
-				}
-#endif
-#ifdef ENABLE_UDP
-				if (!strcmp(address_get_proto(server.address), "udp")) {
-					server.sock = socket(AF_INET, SOCK_DGRAM, 0);
-					int opt = 1;
-					if (setsockopt (server.sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof (opt)) == -1)
-						goto udp_server_final;
-
-					struct sockaddr_in srv = { 0 };
-					srv.sin_family = AF_INET;
-					srv.sin_port = htons (address_get_port(server.address));
-					inet_pton (AF_INET, address_get_host(server.address), &srv.sin_addr.s_addr);
-					if (bind (server.sock, (struct sockaddr *) &srv, sizeof (struct sockaddr_in)) == -1)
-						goto udp_server_final;
+				break;
+			}
 
-					break;
+			case 'w': { // worker pool threads, 0 - run methods on the reading thread
+				server.workers = atoi(optarg);
+				if (server.workers < 0)
+					server.workers = 0;
+				break;
+			}
 
-					udp_server_final:
-					ERROR ("server at '%s': %s", address_get_url(server.address), strerror (errno));
-					if (server.sock > 0)
-						close(server.sock);
+			case 'g': { // seconds to finish requests in flight on stop
+				server.grace = atoi(optarg);
+				if (server.grace < 0)
+					server.grace = SHUTDOWN_GRACE;
+				break;
+			}
 
-					return -1;
-				}
-#endif
-				ERROR("protocol '%s' not compiled", address_get_proto(server.address));
-				if (server.loader)
-					rbtree_destroy(server.loader);
+			case 'i': { // seconds without input before connection is closed
+				server.idle = atoi(optarg);
+				if (server.idle < 0)
+					server.idle = 0;
+				break;
+			}
 
-				return -1;
+			case 'q': { // worker pool queue depth
+				server.depth = atoi(optarg);
+				if (server.depth <= 0)
+					server.depth = WORKER_QUEUE_DEPTH;
+				break;
 			}
 
-			case 'c': {
-				server.confdir = optarg;
+			case 'C': { // open connections limit, 0 - unlimited
+				server.admit.connections = atoi(optarg);
+				if (server.admit.connections < 0)
+					server.admit.connections = 0;
 				break;
 			}
 
-			case 'U': { // set process user
-				struct passwd *uid = getpwnam(optarg);
-				if (uid) {
-					if (setuid(uid->pw_uid))
-						printf("set user id error: %s\n", strerror(errno));
-					else	printf("set user id: %s\n", optarg);
-				}
-				else
-					printf("can't get uid from user: %s\n", optarg);
+			case 'F': { // in flight requests limit, 0 - unlimited
+				server.admit.flight = atoi(optarg);
+				if (server.admit.flight < 0)
+					server.admit.flight = 0;
 				break;
 			}
 
-			case 'G': { // set process group
-				struct group *gid = getgrnam(optarg);
-				if (gid) {
-					if (setgid(gid->gr_gid))
-						printf("set group id error: %s\n", strerror(errno));
-					else	printf("set group id: %s\n", optarg);
-				}
-				else
-					printf("can't get gid from group: %s\n", optarg);
+			case 'f': { // in flight requests limit per connection, 0 - unlimited
+				server.admit.conn = atoi(optarg);
+				if (server.admit.conn < 0)
+					server.admit.conn = 0;
+				break;
+			}
+
+			case 'P': { // pause reading over in flight limits instead of overloaded answer
+				server.admit.pause = 1;
+				break;
+			}
+
+			case 'U': { // set process user after binding, before modules are loaded
+				server.user = optarg;
+				break;
+			}
+
+			case 'G': { // set process group after binding, before modules are loaded
+				server.group = optarg;
+				break;
+			}
+
+			case 's': { // SO_REUSEPORT listeners count
+				server.shards = atoi(optarg);
+				if (server.shards <= 0)
+					server.shards = 1;
+				break;
+			}
+
+			case 'L': { // listen backlog
+				server.backlog = atoi(optarg);
+				if (server.backlog <= 0)
+					server.backlog = LISTEN_COUNT;
 				break;
 			}
 
@@ -384,117 +4561,96 @@ int main (int argc, char *argv[]) {
 				break;
 			}
 
-			case 'l': {
-
-				loader_t* loader = loader_create(optarg);
-				if (loader)
-					set_to_rbtree(server.loader, loader_module(loader)->name, loader);
+			case 'l': { // modules are loaded once privileges are dropped
+				if (modules)
+					modules[loads ++] = optarg;
 				break;
 			}
 
 			case '?':
 			case 'h':
 			default:
-				printf("usage: %s [-U user][-G group][-p pid][-l module][-b bindig][-c confdir][-m mode]\n", argv[0]);
+				printf("usage: %s [-U user][-G group][-p pid][-l module][-b bindig][-s shards][-L backlog][-r reactors][-e epoll|uring][-w workers][-q depth][-g grace][-i idle][-C connections][-F flight][-f flight][-P][-c confdir][-m mode]\n", argv[0]);
 		}
 	}
 
-	if (!server.address) {
-		rbtree_destroy(server.loader);
+	if (!server.address || server_bind(&server)) {
+		free(modules);
+		server_unload(&server);
 		return -1;
 	}
 
-	if (server.confdir) {
-		DIR *dir = opendir(server.confdir);
-		if (dir) {
-			connect_t conn = {
-				.server = &server,
-				.parser = parser_create(),
-				.client = { 0 },
-				.target = { 0 },
-				.stat.count = server.stat.count ++,
-			};
-
-			struct dirent *entry;
-
-			while ((entry = readdir(dir)) != NULL) {
-				if (entry->d_type == DT_REG) {
-					char name[PATH_MAX];
-					snprintf(name, PATH_MAX, "%s/%s", server.confdir, entry->d_name);
-					json_node_t* request = parser_parse_file(conn.parser, name);
-					if (request) {
-						json_node_t* answer = json_node_object(NULL);
-						target_request(&conn, &server, request, answer);
-						json_node_destroy(request);
-						json_node_destroy(answer);
-					}
-				}
-			}
-			parser_destroy(conn.parser);
-			closedir(dir);
-		}
-	}
+	// module code and its on_init run without the privileges binding needed
+	server_privileges(&server);
 
-	INFO("server started at '%s'", address_get_url(server.address));
+	int id;
+	for (id = 0; id < loads; id ++)
+		server_load(&server, modules[id]);
+	free(modules);
 
-	if (!strcmp(address_get_proto(server.address), "udp")) {
-		while(1) {
-			struct timeval timer = {.tv_sec = 1, .tv_usec = 0 };
+	thread_observe(server_observe, &server);
 
-			fd_set rfds;
-			FD_ZERO(&rfds);
-			FD_SET (server.sock, &rfds);
+	if (server.confdir)
+		server_confdir(&server);
 
-			if (select (server.sock + 1, &rfds, NULL, NULL, &timer) > 0) {
-				char buffer [IO_BUFFER_SIZE];
-				socklen_t len = sizeof(buffer);
-				struct sockaddr_in client = { 0 };
-				int msgsize = recvfrom(server.sock, buffer, sizeof (buffer), 0, (struct sockaddr *) &client, &len);
-				ERROR("proptocol not ready yet !!!");
-			}
-		}
+	server.stat.started = time(NULL);
+	clock_gettime(CLOCK_MONOTONIC, &server.stat.start);
+
+	INFO("server started at '%s'", address_get_url(server.address));
+
+	// main listener is served by its own thread, main waits for stop signal
+	int stream = 1, accept = 1, dgram = 0;
+#ifdef ENABLE_UDP
+	if (!strcmp(address_get_proto(server.address), "udp"))
+		stream = 0, dgram = 1;
+#endif
+#ifdef ENABLE_SHM
+	if (server_shm(&server))
+		stream = 0;
+#endif
+	// stream and datagram requests run on the worker pool, shm threads answer in place
+	if ((stream || dgram) && server.workers && !(server.worker = worker_create(server.workers, server.depth))) {
+		server_unload(&server);
+		return -1;
 	}
 
-	else {
-		while(1) {
-			struct timeval timer = {.tv_sec = 1, .tv_usec = 0 };
-
-			fd_set rfds;
-			FD_ZERO(&rfds);
-			FD_SET (server.sock, &rfds);
-
-			if (select (server.sock + 1, &rfds, NULL, NULL, &timer) > 0) {
-				connect_t conn = {
-					.server = &server,
-					.parser = parser_create(),
-					.client = { 0 },
-					.stat.count = server.stat.count ++,
-				};
-
-				int optarg = 1;
-				socklen_t optlen = sizeof(conn.client);
-
-				if ((conn.sock = accept(server.sock, (struct sockaddr*)&conn.client, &optlen)) > 0) {
-					setsockopt (conn.sock, SOL_SOCKET, SO_KEEPALIVE, &optarg, sizeof(optarg));
-
-					pthread_t td;
-					pthread_attr_t attr;
-					pthread_attr_init(&attr);
-					pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED);
-					pthread_mutex_lock(&server.mutex);
-					if (pthread_create(&td, &attr, (void*(*)(void*)) connect_thread, &conn))
-						INFO ("%s", strerror (errno));
-					else	pthread_cond_wait(&server.cond, &server.mutex);
-					pthread_mutex_unlock(&server.mutex);
-					pthread_attr_destroy(&attr);
-				}
+	if (stream) {
+#ifdef HAVE_SYS_EPOLL_H
+		if (server.reactors && reactor_start(&server)) {
+			server_unload(&server);
+			return -1;
+		}
+#endif
+		// sharded listeners and io_uring listeners are accepted by reactors
+		accept = !(server.reactors && (server.shards > 1 || server.uring));
 
-				else
-					close(conn.sock);
+		// listener threads are joined by server_stop
+		for (id = 1; accept && id < server.shards; id ++) {
+			int res = pthread_create(&server.shard[id].td, NULL, (void*(*)(void*)) shard_serve, &server.shard[id]);
+			if (res) {
+				ERROR("pthread_create: %s", strerror(res));
+				server.shard[id].td = 0;
 			}
 		}
 	}
 
-	rbtree_destroy(server.loader);
+	int res = accept ? pthread_create(&server.shard[0].td, NULL, (void*(*)(void*)) server_serve, &server) : 0;
+	if (res) {
+		ERROR("pthread_create: %s", strerror(res));
+		worker_destroy(server.worker);
+		server_unload(&server);
+		return -1;
+	}
+
+	int sig;
+	sigwait(&signals, &sig);
+
+	// calls still running use module code, it is left loaded
+	if (server_stop(&server, &signals))
+		return -1;
+
+	worker_destroy(server.worker);
+	server_unload(&server);
+	INFO("server stopped");
 	return 0;
 }
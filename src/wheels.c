@@ -0,0 +1,146 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include "wheels.h"
+
+#define WHEELS_BITS 6
+#define WHEELS_SLOTS (1 << WHEELS_BITS)
+#define WHEELS_MASK (WHEELS_SLOTS - 1)
+#define WHEELS_LEVELS 4
+
+struct wheels_s {
+
+	uint32_t tick;
+	uint64_t current;
+	int count;
+
+	// level n slot spans WHEELS_SLOTS^n ticks, far timers fall to lower levels as time comes
+	wheels_timer_t* slot[WHEELS_LEVELS][WHEELS_SLOTS];
+};
+
+wheels_t* wheels_create(uint32_t tick, uint64_t now) {
+
+	if (!tick)
+		return NULL;
+
+	wheels_t* wheels = calloc(1, sizeof(*wheels));
+	if (wheels) {
+		wheels->tick = tick;
+		wheels->current = now / tick;
+	}
+
+	return wheels;
+}
+
+void wheels_destroy(void* data) {
+
+	free(data);
+}
+
+static void wheels_link(wheels_t* wheels, wheels_timer_t* timer) {
+
+	uint64_t delta = timer->expire > wheels->current ? timer->expire - wheels->current : 0;
+
+	int level = 0;
+	while (level < WHEELS_LEVELS - 1 && delta >= (uint64_t)1 << (WHEELS_BITS * (level + 1)))
+		level ++;
+
+	// farther than the top level reaches, it is cascaded again on the way
+	uint64_t expire = timer->expire;
+	if (delta >> (WHEELS_BITS * WHEELS_LEVELS))
+		expire = wheels->current + ((uint64_t)1 << (WHEELS_BITS * WHEELS_LEVELS)) - 1;
+
+	wheels_timer_t** slot = &wheels->slot[level][(expire >> (WHEELS_BITS * level)) & WHEELS_MASK];
+	timer->next = *slot;
+	timer->prev = slot;
+	if (*slot)
+		(*slot)->prev = &timer->next;
+	*slot = timer;
+}
+
+static void wheels_unlink(wheels_timer_t* timer) {
+
+	*timer->prev = timer->next;
+	if (timer->next)
+		timer->next->prev = timer->prev;
+
+	timer->next = NULL;
+	timer->prev = NULL;
+}
+
+void wheels_add(wheels_t* wheels, wheels_timer_t* timer, uint64_t timeout) {
+
+	if (!wheels || !timer)
+		return;
+
+	if (timer->prev)
+		wheels_unlink(timer);
+	else	wheels->count ++;
+
+	// part of tick is waited as whole tick, timer never fires early
+	timer->expire = wheels->current + (timeout + wheels->tick - 1) / wheels->tick;
+	if (timer->expire == wheels->current)
+		timer->expire ++;
+
+	wheels_link(wheels, timer);
+}
+
+void wheels_del(wheels_t* wheels, wheels_timer_t* timer) {
+
+	if (!wheels || !timer || !timer->prev)
+		return;
+
+	wheels_unlink(timer);
+	wheels->count --;
+}
+
+wheels_timer_t* wheels_expire(wheels_t* wheels, uint64_t now) {
+
+	if (!wheels)
+		return NULL;
+
+	uint64_t target = now / wheels->tick;
+	wheels_timer_t* expired = NULL;
+
+	// empty wheel jumps, otherwise every tick is walked
+	if (!wheels->count && target > wheels->current)
+		wheels->current = target;
+
+	while (wheels->current < target) {
+		wheels->current ++;
+
+		// upper slot reached by current is spread over lower levels first
+		int level;
+		for (level = 1; level < WHEELS_LEVELS; level ++) {
+			if (wheels->current & (((uint64_t)1 << (WHEELS_BITS * level)) - 1))
+				break;
+
+			wheels_timer_t** slot = &wheels->slot[level][(wheels->current >> (WHEELS_BITS * level)) & WHEELS_MASK];
+			wheels_timer_t* timer = *slot;
+			*slot = NULL;
+
+			while (timer) {
+				wheels_timer_t* next = timer->next;
+				wheels_link(wheels, timer);
+				timer = next;
+			}
+		}
+
+		wheels_timer_t** slot = &wheels->slot[0][wheels->current & WHEELS_MASK];
+		while (*slot) {
+			wheels_timer_t* timer = *slot;
+			wheels_unlink(timer);
+
+			// timer capped at top level reach goes round again
+			if (timer->expire > wheels->current) {
+				wheels_link(wheels, timer);
+				continue;
+			}
+
+			wheels->count --;
+			timer->next = expired;
+			expired = timer;
+		}
+	}
+
+	return expired;
+}
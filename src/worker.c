@@ -0,0 +1,221 @@
+
+#include <time.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "logger.h"
+#include "worker.h"
+
+typedef struct worker_job_s worker_job_t;
+
+struct worker_job_s {
+
+	void (*run_f)(void*);
+	void* data;
+	struct timespec pushed;
+};
+
+struct worker_s {
+
+	pthread_cond_t empty;
+	pthread_cond_t full;
+	pthread_mutex_t mutex;
+
+	int threads;
+	pthread_t* td;
+
+	worker_job_t* queue;
+	int depth;
+	int head;
+	int used;
+	int stopped;
+
+	struct {
+		uint64_t pushed;
+		uint64_t finished;
+		uint64_t blocked;
+		uint64_t wait_total;
+		uint64_t wait_max;
+		int depth_max;
+		int running;
+	} stat;
+};
+
+static uint64_t worker_elapsed(struct timespec* from) {
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - from->tv_sec) * 1000000LL + (now.tv_nsec - from->tv_nsec) / 1000;
+}
+
+static void worker_thread(worker_t* worker) {
+
+	pthread_mutex_lock(&worker->mutex);
+	while (1) {
+		while (!worker->used && !worker->stopped)
+			pthread_cond_wait(&worker->empty, &worker->mutex);
+
+		if (!worker->used)
+			break;
+
+		worker_job_t job = worker->queue[worker->head];
+		worker->head = (worker->head + 1) % worker->depth;
+		worker->used --;
+
+		uint64_t wait = worker_elapsed(&job.pushed);
+		worker->stat.wait_total += wait;
+		if (wait > worker->stat.wait_max)
+			worker->stat.wait_max = wait;
+
+		worker->stat.running ++;
+		pthread_cond_signal(&worker->full);
+		pthread_mutex_unlock(&worker->mutex);
+
+		job.run_f(job.data);
+
+		pthread_mutex_lock(&worker->mutex);
+		worker->stat.running --;
+		worker->stat.finished ++;
+	}
+	pthread_mutex_unlock(&worker->mutex);
+}
+
+worker_t* worker_create(int threads, int depth) {
+
+	if (threads <= 0 || depth <= 0)
+		return NULL;
+
+	worker_t* worker = calloc(1, sizeof(*worker));
+	if (!worker)
+		return NULL;
+
+	pthread_mutex_init(&worker->mutex, NULL);
+	pthread_cond_init(&worker->empty, NULL);
+	pthread_cond_init(&worker->full, NULL);
+
+	worker->depth = depth;
+	worker->queue = calloc(depth, sizeof(worker_job_t));
+	worker->td = calloc(threads, sizeof(pthread_t));
+	if (!worker->queue || !worker->td) {
+		worker_destroy(worker);
+		return NULL;
+	}
+
+	while (worker->threads < threads) {
+		if (pthread_create(&worker->td[worker->threads], NULL, (void*(*)(void*)) worker_thread, worker)) {
+			ERROR("pthread_create: %s", strerror(errno));
+			worker_destroy(worker);
+			return NULL;
+		}
+
+		worker->threads ++;
+	}
+
+	INFO("worker pool started with %d threads, queue depth %d", threads, depth);
+	return worker;
+}
+
+void worker_destroy(void* data) {
+
+	if (!data)
+		return;
+
+	worker_t* worker = data;
+
+	pthread_mutex_lock(&worker->mutex);
+	worker->stopped = 1;
+	pthread_cond_broadcast(&worker->empty);
+	pthread_mutex_unlock(&worker->mutex);
+
+	while (worker->threads --)
+		pthread_join(worker->td[worker->threads], NULL);
+
+	pthread_cond_destroy(&worker->full);
+	pthread_cond_destroy(&worker->empty);
+	pthread_mutex_destroy(&worker->mutex);
+
+	free(worker->queue);
+	free(worker->td);
+	free(data);
+}
+
+static int worker_queue(worker_t* worker, void (*run_f)(void*), void* data, int wait) {
+
+	if (!worker || !run_f)
+		return -1;
+
+	pthread_mutex_lock(&worker->mutex);
+	if (worker->used == worker->depth) {
+		if (!wait) {
+			pthread_mutex_unlock(&worker->mutex);
+			return -1;
+		}
+
+		worker->stat.blocked ++;
+		while (worker->used == worker->depth && !worker->stopped)
+			pthread_cond_wait(&worker->full, &worker->mutex);
+	}
+
+	if (worker->stopped) {
+		pthread_mutex_unlock(&worker->mutex);
+		return -1;
+	}
+
+	worker_job_t* job = &worker->queue[(worker->head + worker->used) % worker->depth];
+	job->run_f = run_f;
+	job->data = data;
+	clock_gettime(CLOCK_MONOTONIC, &job->pushed);
+
+	worker->used ++;
+	worker->stat.pushed ++;
+	if (worker->used > worker->stat.depth_max)
+		worker->stat.depth_max = worker->used;
+
+	pthread_cond_signal(&worker->empty);
+	pthread_mutex_unlock(&worker->mutex);
+	return 0;
+}
+
+int worker_push(worker_t* worker, void (*run_f)(void*), void* data) {
+
+	return worker_queue(worker, run_f, data, !0);
+}
+
+int worker_try(worker_t* worker, void (*run_f)(void*), void* data) {
+
+	return worker_queue(worker, run_f, data, 0);
+}
+
+int worker_depth(worker_t* worker) {
+
+	if (!worker)
+		return -1;
+
+	pthread_mutex_lock(&worker->mutex);
+	int depth = worker->used;
+	pthread_mutex_unlock(&worker->mutex);
+	return depth;
+}
+
+int worker_info(worker_t* worker, json_node_t* info) {
+
+	if (!worker || !info)
+		return -1;
+
+	pthread_mutex_lock(&worker->mutex);
+	json_node_object_add(info, "threads", json_node_int(worker->threads));
+	json_node_object_add(info, "running", json_node_int(worker->stat.running));
+	json_node_object_add(info, "depth", json_node_int(worker->used));
+	json_node_object_add(info, "depth_max", json_node_int(worker->stat.depth_max));
+	json_node_object_add(info, "depth_limit", json_node_int(worker->depth));
+	json_node_object_add(info, "pushed", json_node_long(worker->stat.pushed));
+	json_node_object_add(info, "finished", json_node_long(worker->stat.finished));
+	json_node_object_add(info, "blocked", json_node_long(worker->stat.blocked));
+	uint64_t started = worker->stat.pushed - worker->used;
+	json_node_object_add(info, "wait_avg_us", json_node_double(started ? (double)worker->stat.wait_total / started : 0));
+	json_node_object_add(info, "wait_max_us", json_node_long(worker->stat.wait_max));
+	pthread_mutex_unlock(&worker->mutex);
+	return 0;
+}